@@ -0,0 +1,123 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <iterator>
+
+extern "C"
+{
+#include <libevdev/libevdev.h>
+}
+
+#include "event-names.hpp"
+
+/*
+ * Times name-to-code lookups through the tables built at init against
+ * building a "KEY_"/"BTN_" name and asking libevdev, as requests used to.
+ */
+
+static const int ROUNDS = 200000;
+
+/* Names as keystroke and buttonstroke get them, without the prefixes */
+static const char *key_names[] = {
+    "A", "Z", "ENTER", "LEFTSHIFT", "SPACE", "F12", "KP5", "VOLUMEUP", "BRIGHTNESSDOWN",
+};
+
+static const char *button_names[] = {
+    "LEFT", "RIGHT", "MIDDLE", "SIDE", "EXTRA",
+};
+
+template<class Lookup>
+static double time_lookups(Lookup lookup)
+{
+    int sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ROUNDS; i++)
+    {
+        for (auto name : key_names)
+        {
+            sum += lookup(name, false);
+        }
+
+        for (auto name : button_names)
+        {
+            sum += lookup(name, true);
+        }
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    /* Keep the lookups from being optimized away */
+    if (sum == 42)
+    {
+        printf(" ");
+    }
+
+    double count = double(ROUNDS) * (std::size(key_names) + std::size(button_names));
+    return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main()
+{
+    wayfire_control_event_names names;
+
+    /* Both ways must agree before their speed means anything */
+    for (auto name : key_names)
+    {
+        std::string full = std::string("KEY_") + name;
+        if (names.key_from_name(name) != libevdev_event_code_from_name(EV_KEY, full.c_str()))
+        {
+            fprintf(stderr, "Key %s looked up differently\n", name);
+            return 1;
+        }
+    }
+
+    for (auto name : button_names)
+    {
+        std::string full = std::string("BTN_") + name;
+        if (names.button_from_name(name) != libevdev_event_code_from_name(EV_KEY, full.c_str()))
+        {
+            fprintf(stderr, "Button %s looked up differently\n", name);
+            return 1;
+        }
+    }
+
+    double table = time_lookups([&] (const char *name, bool button)
+    {
+        return button ? names.button_from_name(name) : names.key_from_name(name);
+    });
+
+    double evdev = time_lookups([] (const char *name, bool button)
+    {
+        std::string full = std::string(button ? "BTN_" : "KEY_") + name;
+        return libevdev_event_code_from_name(EV_KEY, full.c_str());
+    });
+
+    printf("tables:  %8.1f ns per lookup\n", table);
+    printf("libevdev: %7.1f ns per lookup\n", evdev);
+    return 0;
+}
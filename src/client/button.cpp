@@ -4,9 +4,11 @@
 #include <string>
 #include "wf-ctrl.hpp"
 
-void do_button(WfCtrl *wd, int argc, char *argv[])
+bool do_button(WfCtrl *wd, int argc, char *argv[])
 {
     std::string key;
+    uint32_t code;
+    bool codes = false;
     int delay = 12;
 
     struct option opts[] = {
@@ -14,41 +16,70 @@ void do_button(WfCtrl *wd, int argc, char *argv[])
         { "buttondown",   required_argument, NULL, 'd' },
         { "buttonup",     required_argument, NULL, 'u' },
         { "delay",        required_argument, NULL, 'm' },
+        { "codes",        no_argument,       NULL, 'c' },
         { 0,              0,                 NULL,  0  }
     };
 
     int c, i;
-    while((c = getopt_long(argc - 1, argv + 1, "b:d:u:m:", opts, &i)) != -1)
+    while((c = getopt_long(argc - 1, argv + 1, "b:d:u:m:c", opts, &i)) != -1)
     {
         switch(c)
         {
             case 'b':
+                if (codes && wd->parse_code(optarg, code))
+                {
+                    wf_ctrl_base_buttonstroke_code(wd->wf_control_manager, code, delay);
+                    wd->request_sent();
+                    break;
+                }
+
                 key = optarg;
                 std::transform(key.begin(), key.end(), key.begin(), ::toupper);
                 wf_ctrl_base_buttonstroke(wd->wf_control_manager, key.c_str(), delay);
+                wd->request_sent();
                 break;
 
             case 'd':
+                if (codes && wd->parse_code(optarg, code))
+                {
+                    wf_ctrl_base_buttondown_code(wd->wf_control_manager, code);
+                    wd->request_sent();
+                    break;
+                }
+
                 key = optarg;
                 std::transform(key.begin(), key.end(), key.begin(), ::toupper);
                 wf_ctrl_base_buttondown(wd->wf_control_manager, key.c_str());
+                wd->request_sent();
                 break;
 
             case 'u':
+                if (codes && wd->parse_code(optarg, code))
+                {
+                    wf_ctrl_base_buttonup_code(wd->wf_control_manager, code);
+                    wd->request_sent();
+                    break;
+                }
+
                 key = optarg;
                 std::transform(key.begin(), key.end(), key.begin(), ::toupper);
                 wf_ctrl_base_buttonup(wd->wf_control_manager, key.c_str());
+                wd->request_sent();
                 break;
 
             case 'm':
                 delay = atoi(optarg);
                 break;
 
+            case 'c':
+                codes = true;
+                break;
+
             default:
                 printf("Unsupported command line argument %s\n", optarg);
-                return;
+                return false;
         }
     }
 
-    wd->run();
+    return true;
 }
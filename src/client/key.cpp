@@ -4,51 +4,101 @@
 #include <algorithm>
 #include "wf-ctrl.hpp"
 
-void do_key(WfCtrl *wd, int argc, char *argv[])
+bool do_key(WfCtrl *wd, int argc, char *argv[])
 {
     std::string key;
+    uint32_t code;
+    bool codes = false;
     int delay = 12;
+    int interval = 0;
 
     struct option opts[] = {
         { "keystroke",   required_argument, NULL, 'k' },
         { "keydown",     required_argument, NULL, 'd' },
         { "keyup",       required_argument, NULL, 'u' },
         { "delay",       required_argument, NULL, 'm' },
+        { "codes",       no_argument,       NULL, 'c' },
+        { "type",        required_argument, NULL, 't' },
+        { "interval",    required_argument, NULL, 'i' },
         { 0,             0,                 NULL,  0  }
     };
 
     int c, i;
-    while((c = getopt_long(argc - 1, argv + 1, "k:d:u:m:", opts, &i)) != -1)
+    while((c = getopt_long(argc - 1, argv + 1, "k:d:u:m:t:i:c", opts, &i)) != -1)
     {
         switch(c)
         {
             case 'k':
+                if (codes && wd->parse_code(optarg, code))
+                {
+                    wf_ctrl_base_keystroke_code(wd->wf_control_manager, code, delay);
+                    wd->request_sent();
+                    break;
+                }
+
                 key = optarg;
                 std::transform(key.begin(), key.end(), key.begin(), ::toupper);
                 wf_ctrl_base_keystroke(wd->wf_control_manager, key.c_str(), delay);
+                wd->request_sent();
                 break;
 
             case 'd':
+                if (codes && wd->parse_code(optarg, code))
+                {
+                    wf_ctrl_base_keydown_code(wd->wf_control_manager, code);
+                    wd->request_sent();
+                    break;
+                }
+
                 key = optarg;
                 std::transform(key.begin(), key.end(), key.begin(), ::toupper);
                 wf_ctrl_base_keydown(wd->wf_control_manager, key.c_str());
+                wd->request_sent();
                 break;
 
             case 'u':
+                if (codes && wd->parse_code(optarg, code))
+                {
+                    wf_ctrl_base_keyup_code(wd->wf_control_manager, code);
+                    wd->request_sent();
+                    break;
+                }
+
                 key = optarg;
                 std::transform(key.begin(), key.end(), key.begin(), ::toupper);
                 wf_ctrl_base_keyup(wd->wf_control_manager, key.c_str());
+                wd->request_sent();
                 break;
 
             case 'm':
                 delay = atoi(optarg);
                 break;
 
+            case 'c':
+                codes = true;
+                break;
+
+            case 't':
+                if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+                    WF_CTRL_BASE_TYPE_TEXT_SINCE_VERSION)
+                {
+                    printf("The compositor cannot type text\n");
+                    return false;
+                }
+
+                wf_ctrl_base_type_text(wd->wf_control_manager, optarg, interval);
+                wd->request_sent();
+                break;
+
+            case 'i':
+                interval = atoi(optarg);
+                break;
+
             default:
                 printf("Unsupported command line argument %s\n", optarg);
-                return;
+                return false;
         }
     }
 
-    wd->run();
+    return true;
 }
\ No newline at end of file
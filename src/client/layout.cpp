@@ -0,0 +1,88 @@
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "wf-ctrl.hpp"
+
+/* Save the layout of all views to a file, or to stdout if it is - */
+bool do_save_layout(WfCtrl *wd, int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: wf-ctrl save-layout FILE\n");
+        return false;
+    }
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_SAVE_LAYOUT_SINCE_VERSION)
+    {
+        printf("The compositor cannot save layouts\n");
+        return false;
+    }
+
+    /* With --stdin, stdout carries the results of the commands */
+    if (wd->stdin_mode && !strcmp(argv[2], "-"))
+    {
+        printf("Cannot save to stdout with --stdin\n");
+        return false;
+    }
+
+    int fd = strcmp(argv[2], "-") ?
+        open(argv[2], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : STDOUT_FILENO;
+    if (fd < 0)
+    {
+        printf("Cannot open %s: %s\n", argv[2], strerror(errno));
+        return false;
+    }
+
+    /* The fd is duplicated when the request is marshalled */
+    wf_ctrl_base_save_layout(wd->wf_control_manager, fd);
+    wd->request_sent();
+    if (fd != STDOUT_FILENO)
+    {
+        close(fd);
+    }
+
+    return true;
+}
+
+/* Restore a layout saved with save-layout, from stdin if the file is - */
+bool do_restore_layout(WfCtrl *wd, int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: wf-ctrl restore-layout FILE\n");
+        return false;
+    }
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_RESTORE_LAYOUT_SINCE_VERSION)
+    {
+        printf("The compositor cannot restore layouts\n");
+        return false;
+    }
+
+    /* With --stdin, stdin carries the commands */
+    if (wd->stdin_mode && !strcmp(argv[2], "-"))
+    {
+        printf("Cannot restore from stdin with --stdin\n");
+        return false;
+    }
+
+    int fd = strcmp(argv[2], "-") ? open(argv[2], O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    if (fd < 0)
+    {
+        printf("Cannot open %s: %s\n", argv[2], strerror(errno));
+        return false;
+    }
+
+    wf_ctrl_base_restore_layout(wd->wf_control_manager, fd);
+    wd->request_sent();
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+
+    return true;
+}
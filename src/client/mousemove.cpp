@@ -1,18 +1,62 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
 #include <getopt.h>
 #include "wf-ctrl.hpp"
 
-void do_mousemove(WfCtrl *wd, int argc, char *argv[])
+/* Send a mouse_path for points given as x,y:x,y:... */
+static bool send_path(WfCtrl *wd, const char *arg, uint32_t curve, uint32_t duration)
+{
+    std::vector<int32_t> coords;
+    int x, y, len;
+
+    while (sscanf(arg, "%d,%d%n", &x, &y, &len) == 2)
+    {
+        coords.push_back(x);
+        coords.push_back(y);
+        arg += len;
+        if (*arg != ':')
+        {
+            break;
+        }
+
+        arg++;
+    }
+
+    if (coords.empty() || *arg)
+    {
+        return false;
+    }
+
+    wl_array points;
+    wl_array_init(&points);
+    memcpy(wl_array_add(&points, coords.size() * sizeof(int32_t)),
+        coords.data(), coords.size() * sizeof(int32_t));
+    wf_ctrl_base_mouse_path(wd->wf_control_manager, &points, curve, duration);
+    wl_array_release(&points);
+    wd->request_sent();
+    return true;
+}
+
+bool do_mousemove(WfCtrl *wd, int argc, char *argv[])
 {
     int x, y;
+    uint32_t curve    = WF_CTRL_BASE_PATH_CURVE_POLYLINE;
+    uint32_t duration = 500;
+    const char *output = NULL;
 
     struct option opts[] = {
         { "mousemove",      required_argument, NULL, 'm' },
+        { "path",           required_argument, NULL, 'p' },
+        { "bezier",         no_argument,       NULL, 'b' },
+        { "duration",       required_argument, NULL, 't' },
+        { "output",         required_argument, NULL, 'o' },
         { 0,                0,                 NULL,  0  }
     };
 
     int c, i;
-    while((c = getopt_long(argc - 1, argv + 1, "m:", opts, &i)) != -1)
+    while((c = getopt_long(argc - 1, argv + 1, "m:p:bt:o:", opts, &i)) != -1)
     {
         switch(c)
         {
@@ -21,14 +65,56 @@ void do_mousemove(WfCtrl *wd, int argc, char *argv[])
                 {
                     break;
                 }
-                wf_ctrl_base_mousemove(wd->wf_control_manager, x, y);
+                if (output)
+                {
+                    wf_ctrl_base_mousemove_output(wd->wf_control_manager, output, x, y);
+                }
+                else
+                {
+                    wf_ctrl_base_mousemove(wd->wf_control_manager, x, y);
+                }
+                wd->request_sent();
+                break;
+
+            case 'o':
+                if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+                    WF_CTRL_BASE_MOUSEMOVE_OUTPUT_SINCE_VERSION)
+                {
+                    printf("The compositor cannot position the pointer on an output\n");
+                    return false;
+                }
+
+                output = optarg;
+                break;
+
+            case 'p':
+                if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+                    WF_CTRL_BASE_MOUSE_PATH_SINCE_VERSION)
+                {
+                    printf("The compositor cannot move the pointer along a path\n");
+                    return false;
+                }
+
+                if (!send_path(wd, optarg, curve, duration))
+                {
+                    printf("Invalid path %s\n", optarg);
+                    return false;
+                }
+                break;
+
+            case 'b':
+                curve = WF_CTRL_BASE_PATH_CURVE_BEZIER;
+                break;
+
+            case 't':
+                duration = atoi(optarg);
                 break;
 
             default:
                 printf("Unsupported command line argument %s\n", optarg);
-                return;
+                return false;
         }
     }
 
-    wd->run();
+    return true;
 }
\ No newline at end of file
@@ -0,0 +1,95 @@
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "wf-ctrl.hpp"
+
+/* Send an input script from a file, or from stdin if it is - */
+bool do_replay(WfCtrl *wd, int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: wf-ctrl replay FILE\n");
+        return false;
+    }
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_REPLAY_SINCE_VERSION)
+    {
+        printf("The compositor cannot replay input\n");
+        return false;
+    }
+
+    /* With --stdin, stdin carries the commands */
+    if (wd->stdin_mode && !strcmp(argv[2], "-"))
+    {
+        printf("Cannot replay from stdin with --stdin\n");
+        return false;
+    }
+
+    int fd = strcmp(argv[2], "-") ? open(argv[2], O_RDONLY | O_CLOEXEC) : STDIN_FILENO;
+    if (fd < 0)
+    {
+        printf("Cannot open %s: %s\n", argv[2], strerror(errno));
+        return false;
+    }
+
+    /* The fd is duplicated when the request is marshalled */
+    wf_ctrl_base_replay(wd->wf_control_manager, fd);
+    wd->request_sent();
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+
+    return true;
+}
+
+/* Record real input to a file until interrupted */
+bool do_record(WfCtrl *wd, int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        printf("Usage: wf-ctrl record FILE\n");
+        return false;
+    }
+
+    if (wd->stdin_mode ||
+        (wf_ctrl_base_get_version(wd->wf_control_manager) <
+         WF_CTRL_BASE_RECORD_SINCE_VERSION))
+    {
+        printf("Cannot record input here\n");
+        return false;
+    }
+
+    int fd = strcmp(argv[2], "-") ?
+        open(argv[2], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : STDOUT_FILENO;
+    if (fd < 0)
+    {
+        printf("Cannot open %s: %s\n", argv[2], strerror(errno));
+        return false;
+    }
+
+    wf_ctrl_base_record(wd->wf_control_manager, fd);
+    wd->request_sent();
+    if (fd != STDOUT_FILENO)
+    {
+        close(fd);
+    }
+
+    if (!wd->wait() || wd->exit_status)
+    {
+        return false;
+    }
+
+    fprintf(stderr, "Recording, press Ctrl-C to stop\n");
+    if (!wd->dispatch_until_interrupted())
+    {
+        return false;
+    }
+
+    wf_ctrl_base_record_stop(wd->wf_control_manager);
+    wd->request_sent();
+    return true;
+}
@@ -0,0 +1,60 @@
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "wf-ctrl.hpp"
+
+bool do_scroll(WfCtrl *wd, int argc, char *argv[])
+{
+    bool continuous = false;
+
+    struct option opts[] = {
+        { "vertical",    required_argument, NULL, 'v' },
+        { "horizontal",  required_argument, NULL, 'h' },
+        { "continuous",  no_argument,       NULL, 'c' },
+        { 0,             0,                 NULL,  0  }
+    };
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_AXIS_SINCE_VERSION)
+    {
+        printf("The compositor cannot scroll\n");
+        return false;
+    }
+
+    int c, i;
+    while((c = getopt_long(argc - 1, argv + 1, "v:h:c", opts, &i)) != -1)
+    {
+        switch(c)
+        {
+            case 'v':
+            case 'h':
+            {
+                uint32_t orientation = (c == 'v') ?
+                    WF_CTRL_BASE_AXIS_ORIENTATION_VERTICAL :
+                    WF_CTRL_BASE_AXIS_ORIENTATION_HORIZONTAL;
+                if (continuous)
+                {
+                    wf_ctrl_base_axis(wd->wf_control_manager, orientation,
+                        wl_fixed_from_double(atof(optarg)), 0);
+                }
+                else
+                {
+                    wf_ctrl_base_axis(wd->wf_control_manager, orientation,
+                        0, atoi(optarg));
+                }
+                wd->request_sent();
+                break;
+            }
+
+            case 'c':
+                continuous = true;
+                break;
+
+            default:
+                printf("Unsupported command line argument %s\n", optarg);
+                return false;
+        }
+    }
+
+    return true;
+}
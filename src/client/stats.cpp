@@ -0,0 +1,25 @@
+#include <cstdio>
+#include <cstring>
+#include "wf-ctrl.hpp"
+
+/* Print the latencies of recent requests, by request and stage */
+bool do_stats(WfCtrl *wd, int argc, char *argv[])
+{
+    if ((argc > 3) || ((argc == 3) && strcmp(argv[2], "-H")))
+    {
+        printf("Usage: wf-ctrl stats [-H]\n");
+        return false;
+    }
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_STATS_SINCE_VERSION)
+    {
+        printf("The compositor has no stats\n");
+        return false;
+    }
+
+    wd->print_histograms = (argc == 3);
+    wf_ctrl_base_stats(wd->wf_control_manager);
+    wd->request_sent();
+    return true;
+}
@@ -0,0 +1,313 @@
+#include <cstdio>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <cctype>
+#include <algorithm>
+#include <poll.h>
+#include <unistd.h>
+#include "wf-ctrl.hpp"
+
+static void print_result(int line, uint32_t status)
+{
+    printf("%d %s\n", line, status_to_string(status));
+    fflush(stdout);
+}
+
+void WfCtrl::command_done(uint32_t serial, uint32_t status)
+{
+    /*
+     * Requests answered once they have finished, like typing or waits,
+     * reply after later ones, so replies go by the serials of each command
+     */
+    auto cmd = std::find_if(commands.begin(), commands.end(), [=] (auto& c)
+    {
+        return (serial >= c.first_serial) && (serial <= c.last_serial);
+    });
+    if (cmd == commands.end())
+    {
+        return;
+    }
+
+    if (cmd->status == WF_CTRL_BASE_STATUS_OK)
+    {
+        cmd->status = status;
+    }
+
+    if (--cmd->outstanding == 0)
+    {
+        print_result(cmd->line, cmd->status);
+        commands.erase(cmd);
+    }
+}
+
+/*
+ * Split a line into words as a shell would: whitespace separates words,
+ * single quotes keep everything literally, double quotes keep all but \\
+ * and \", and a backslash outside quotes escapes the next character.
+ * Returns false on an unterminated quote or a trailing backslash.
+ */
+static bool split_words(const std::string& text, std::vector<std::string>& words)
+{
+    std::string word;
+    bool in_word = false;
+    char quote   = 0;
+
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (quote == '\'')
+        {
+            if (c == '\'')
+            {
+                quote = 0;
+            }
+            else
+            {
+                word += c;
+            }
+        }
+        else if (quote == '"')
+        {
+            if (c == '"')
+            {
+                quote = 0;
+            }
+            else if ((c == '\\') && (i + 1 < text.size()) &&
+                     ((text[i + 1] == '\\') || (text[i + 1] == '"')))
+            {
+                word += text[++i];
+            }
+            else
+            {
+                word += c;
+            }
+        }
+        else if (isspace((unsigned char)c))
+        {
+            if (in_word)
+            {
+                words.push_back(word);
+                word.clear();
+                in_word = false;
+            }
+        }
+        else
+        {
+            in_word = true;
+            if ((c == '\'') || (c == '"'))
+            {
+                quote = c;
+            }
+            else if (c == '\\')
+            {
+                if (++i == text.size())
+                {
+                    return false;
+                }
+
+                word += text[i];
+            }
+            else
+            {
+                word += c;
+            }
+        }
+    }
+
+    if (quote)
+    {
+        return false;
+    }
+
+    if (in_word)
+    {
+        words.push_back(word);
+    }
+
+    return true;
+}
+
+static void handle_line(WfCtrl *wd, const std::string& text, int line)
+{
+    /* Comments and blank lines are skipped before any quote is parsed */
+    size_t start = text.find_first_not_of(" \t\r");
+    if ((start == std::string::npos) || (text[start] == '#'))
+    {
+        return;
+    }
+
+    std::vector<std::string> words = {"wf-ctrl"};
+    if (!split_words(text, words))
+    {
+        print_result(line, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    if (words.size() < 2)
+    {
+        return;
+    }
+
+    std::vector<char*> argv;
+    for (auto& w : words)
+    {
+        argv.push_back(&w[0]);
+    }
+
+    argv.push_back(nullptr);
+
+    uint32_t first_serial = wd->serial + 1;
+    uint32_t in_flight    = wd->in_flight;
+    uint32_t status = wd->send_command(words.size(), argv.data()) ?
+        WF_CTRL_BASE_STATUS_OK : WF_CTRL_BASE_STATUS_INVALID_ARGUMENT;
+
+    if (wd->in_flight == in_flight)
+    {
+        /* No reply to wait for, e.g. no view IDs given or a bad argument */
+        print_result(line, status);
+        return;
+    }
+
+    /*
+     * A command can fail after sending some requests. It still waits for
+     * their replies, so they are not taken for those of the next command.
+     */
+    wd->commands.push_back({line, first_serial, wd->serial,
+        wd->in_flight - in_flight, status, now_ms() + wd->timeout});
+}
+
+/*
+ * Read newline separated commands from stdin and send each one as soon as
+ * it is read, without waiting for replies to the previous ones. Results are
+ * printed as "<line> <status>" in the order commands finish.
+ */
+void do_stdin(WfCtrl *wd, bool coalesce)
+{
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_DONE_SINCE_VERSION)
+    {
+        fprintf(stderr, "--stdin needs a newer wf-ctrl plugin\n");
+        wd->exit_status = 1;
+        wl_display_disconnect(wd->display);
+        return;
+    }
+
+    /* Moves streamed faster than frames are rendered only apply the last */
+    if (coalesce)
+    {
+        wf_ctrl_base_set_coalesce(wd->wf_control_manager, 1);
+        wd->request_sent();
+        if (!wd->wait() || wd->exit_status)
+        {
+            wl_display_disconnect(wd->display);
+            return;
+        }
+    }
+
+    wd->stdin_mode = true;
+
+    struct pollfd fds[2];
+    fds[0].fd     = wl_display_get_fd(wd->display);
+    fds[0].events = POLLIN;
+    fds[1].fd     = STDIN_FILENO;
+    fds[1].events = POLLIN;
+
+    std::string buffer;
+    bool eof = false;
+    int line = 0;
+
+    while (!eof || !wd->commands.empty())
+    {
+        while (wl_display_prepare_read(wd->display) != 0)
+        {
+            wl_display_dispatch_pending(wd->display);
+        }
+
+        wl_display_flush(wd->display);
+
+        fds[1].fd = eof ? -1 : STDIN_FILENO;
+
+        /*
+         * Each command times out on its own, however much else comes in.
+         * They are sent in order, so the oldest one times out first.
+         */
+        int wait = -1;
+        if ((wd->timeout >= 0) && !wd->commands.empty())
+        {
+            wait = std::max<int64_t>(0, wd->commands.front().deadline - now_ms());
+        }
+
+        int ret = (wait == 0) ? 0 : poll(fds, 2, wait);
+        if (ret <= 0)
+        {
+            wl_display_cancel_read(wd->display);
+            if ((ret < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            if (ret == 0)
+            {
+                for (auto& cmd : wd->commands)
+                {
+                    printf("%d timeout\n", cmd.line);
+                }
+            }
+
+            wd->exit_status = 1;
+            break;
+        }
+
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
+        {
+            if (wl_display_read_events(wd->display) < 0)
+            {
+                fprintf(stderr, "Lost connection to the compositor\n");
+                wd->exit_status = 1;
+                break;
+            }
+        }
+        else
+        {
+            wl_display_cancel_read(wd->display);
+        }
+
+        if (wl_display_dispatch_pending(wd->display) < 0)
+        {
+            fprintf(stderr, "Lost connection to the compositor\n");
+            wd->exit_status = 1;
+            break;
+        }
+
+        if (fds[1].revents & (POLLIN | POLLHUP))
+        {
+            char data[4096];
+            ssize_t len = read(STDIN_FILENO, data, sizeof(data));
+            if (len <= 0)
+            {
+                eof = true;
+            }
+            else
+            {
+                buffer.append(data, len);
+            }
+
+            size_t pos;
+            while ((pos = buffer.find('\n')) != std::string::npos)
+            {
+                handle_line(wd, buffer.substr(0, pos), ++line);
+                buffer.erase(0, pos + 1);
+            }
+
+            if (eof && !buffer.empty())
+            {
+                handle_line(wd, buffer, ++line);
+                buffer.clear();
+            }
+        }
+    }
+
+    wl_display_flush(wd->display);
+    wl_display_disconnect(wd->display);
+}
@@ -0,0 +1,65 @@
+#include <cstdio>
+#include <getopt.h>
+#include "wf-ctrl.hpp"
+
+bool do_touch(WfCtrl *wd, int argc, char *argv[])
+{
+    int id, x, y;
+
+    struct option opts[] = {
+        { "down",        required_argument, NULL, 'd' },
+        { "motion",      required_argument, NULL, 'm' },
+        { "up",          required_argument, NULL, 'u' },
+        { 0,             0,                 NULL,  0  }
+    };
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_TOUCH_DOWN_SINCE_VERSION)
+    {
+        printf("The compositor cannot inject touch\n");
+        return false;
+    }
+
+    int c, i;
+    while((c = getopt_long(argc - 1, argv + 1, "d:m:u:", opts, &i)) != -1)
+    {
+        switch(c)
+        {
+            case 'd':
+                if (sscanf(optarg, "%d:%d,%d", &id, &x, &y) != 3)
+                {
+                    printf("Invalid touch point %s, expected ID:X,Y\n", optarg);
+                    return false;
+                }
+                wf_ctrl_base_touch_down(wd->wf_control_manager, id, x, y);
+                wd->request_sent();
+                break;
+
+            case 'm':
+                if (sscanf(optarg, "%d:%d,%d", &id, &x, &y) != 3)
+                {
+                    printf("Invalid touch point %s, expected ID:X,Y\n", optarg);
+                    return false;
+                }
+                wf_ctrl_base_touch_motion(wd->wf_control_manager, id, x, y);
+                wd->request_sent();
+                break;
+
+            case 'u':
+                if (sscanf(optarg, "%d", &id) != 1)
+                {
+                    printf("Invalid touch point %s, expected ID\n", optarg);
+                    return false;
+                }
+                wf_ctrl_base_touch_up(wd->wf_control_manager, id);
+                wd->request_sent();
+                break;
+
+            default:
+                printf("Unsupported command line argument %s\n", optarg);
+                return false;
+        }
+    }
+
+    return true;
+}
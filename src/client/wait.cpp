@@ -0,0 +1,68 @@
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "wf-ctrl.hpp"
+
+bool do_wait(WfCtrl *wd, int argc, char *argv[])
+{
+    uint32_t timeout = 0;
+    int id, x, y, w, h;
+
+    struct option opts[] = {
+        { "mapped",      required_argument, NULL, 'm' },
+        { "geometry",    required_argument, NULL, 'g' },
+        { "animation",   required_argument, NULL, 'a' },
+        { "frame",       optional_argument, NULL, 'f' },
+        { "timeout",     required_argument, NULL, 't' },
+        { 0,             0,                 NULL,  0  }
+    };
+
+    if (wf_ctrl_base_get_version(wd->wf_control_manager) <
+        WF_CTRL_BASE_WAIT_VIEW_MAPPED_SINCE_VERSION)
+    {
+        printf("The compositor cannot wait for conditions\n");
+        return false;
+    }
+
+    int c, i;
+    while((c = getopt_long(argc - 1, argv + 1, "m:g:a:f::t:", opts, &i)) != -1)
+    {
+        switch(c)
+        {
+            case 'm':
+                wf_ctrl_base_wait_view_mapped(wd->wf_control_manager, optarg, timeout);
+                wd->request_sent();
+                break;
+
+            case 'g':
+                if (sscanf(optarg, "%d:%d,%d:%dx%d", &id, &x, &y, &w, &h) != 5)
+                {
+                    printf("Invalid geometry %s, expected ID:X,Y:WxH\n", optarg);
+                    return false;
+                }
+                wf_ctrl_base_wait_geometry(wd->wf_control_manager, id, x, y, w, h, timeout);
+                wd->request_sent();
+                break;
+
+            case 'a':
+                wf_ctrl_base_wait_animation(wd->wf_control_manager, atoi(optarg), timeout);
+                wd->request_sent();
+                break;
+
+            case 'f':
+                wf_ctrl_base_wait_frame(wd->wf_control_manager, optarg ? optarg : "", timeout);
+                wd->request_sent();
+                break;
+
+            case 't':
+                timeout = atoi(optarg);
+                break;
+
+            default:
+                printf("Unsupported command line argument %s\n", optarg);
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,66 @@
+#include <cstdio>
+#include <cstring>
+#include "wf-ctrl.hpp"
+
+static const struct
+{
+    const char *name;
+    uint32_t mask;
+} event_names[] = {
+    {"mapped", WF_CTRL_BASE_EVENT_MASK_VIEW_MAPPED},
+    {"unmapped", WF_CTRL_BASE_EVENT_MASK_VIEW_UNMAPPED},
+    {"geometry", WF_CTRL_BASE_EVENT_MASK_VIEW_GEOMETRY},
+    {"focus", WF_CTRL_BASE_EVENT_MASK_FOCUS},
+    {"workspace", WF_CTRL_BASE_EVENT_MASK_WORKSPACE},
+};
+
+/* Print view and workspace changes until interrupted */
+bool do_watch(WfCtrl *wd, int argc, char *argv[])
+{
+    uint32_t mask = 0;
+
+    for (int i = 2; i < argc; i++)
+    {
+        bool found = false;
+        for (auto& event : event_names)
+        {
+            if (!strcmp(argv[i], event.name))
+            {
+                mask |= event.mask;
+                found = true;
+            }
+        }
+
+        if (!found)
+        {
+            printf("Unknown event %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    if (wd->stdin_mode ||
+        (wf_ctrl_base_get_version(wd->wf_control_manager) <
+         WF_CTRL_BASE_SUBSCRIBE_SINCE_VERSION))
+    {
+        printf("Cannot watch events here\n");
+        return false;
+    }
+
+    /* Everything by default */
+    if (!mask)
+    {
+        for (auto& event : event_names)
+        {
+            mask |= event.mask;
+        }
+    }
+
+    wf_ctrl_base_subscribe(wd->wf_control_manager, mask);
+    wd->request_sent();
+    if (!wd->wait() || wd->exit_status)
+    {
+        return false;
+    }
+
+    return wd->dispatch_until_interrupted();
+}
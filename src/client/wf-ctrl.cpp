@@ -24,9 +24,16 @@
 
 
 #include <iostream>
+#include <string>
 #include <string.h>
 #include <getopt.h>
 #include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <poll.h>
+#include <csignal>
+#include <time.h>
 
 #include "wf-ctrl.hpp"
 
@@ -40,7 +47,7 @@ static void registry_add(void *data, struct wl_registry *registry,
     {
         wfm->wf_control_manager = (wf_ctrl_base *)
             wl_registry_bind(registry, id,
-            &wf_ctrl_base_interface, 1);
+            &wf_ctrl_base_interface, std::min(version, 2u));
     }
 }
 
@@ -62,36 +69,317 @@ static void receive_ack(void *data,
 {
     WfCtrl *wfm = (WfCtrl *) data;
 
-    wfm->running = 0;
+    wfm->in_flight--;
+}
+
+
+const char *status_to_string(uint32_t status)
+{
+    switch (status)
+    {
+        case WF_CTRL_BASE_STATUS_OK:
+            return "ok";
+        case WF_CTRL_BASE_STATUS_NO_VIEW:
+            return "no such view";
+        case WF_CTRL_BASE_STATUS_NO_OUTPUT:
+            return "no output";
+        case WF_CTRL_BASE_STATUS_INVALID_ARGUMENT:
+            return "invalid argument";
+        case WF_CTRL_BASE_STATUS_BUSY:
+            return "busy";
+        case WF_CTRL_BASE_STATUS_TIMEOUT:
+            return "timed out";
+        case WF_CTRL_BASE_STATUS_MERGED:
+            return "merged";
+        default:
+            return "unknown status";
+    }
+}
+
+static void receive_done(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t serial, uint32_t status)
+{
+    WfCtrl *wfm = (WfCtrl *) data;
+
+    if (wfm->stdin_mode)
+    {
+        wfm->command_done(serial, status);
+        return;
+    }
+
+    /* Merged requests were superseded by later ones, which is fine */
+    if ((status != WF_CTRL_BASE_STATUS_OK) && (status != WF_CTRL_BASE_STATUS_MERGED))
+    {
+        std::cerr << "Request " << serial << " failed: " << status_to_string(status) << std::endl;
+        wfm->exit_status = 1;
+    }
+
+    wfm->in_flight--;
+}
+
+static void receive_view_info(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t serial, uint32_t id,
+    const char *app_id, const char *title, int32_t x, int32_t y,
+    int32_t width, int32_t height, const char *output,
+    int32_t ws_x, int32_t ws_y, uint32_t state)
+{
+    std::string flags;
+    flags += (state & WF_CTRL_BASE_VIEW_STATE_FOCUSED) ? 'f' : '-';
+    flags += (state & WF_CTRL_BASE_VIEW_STATE_MINIMIZED) ? 'm' : '-';
+    flags += (state & WF_CTRL_BASE_VIEW_STATE_TILED) ? 't' : '-';
+    flags += (state & WF_CTRL_BASE_VIEW_STATE_FULLSCREEN) ? 'F' : '-';
+
+    printf("%u\t%s\t%d,%d %dx%d\t%s\t%d,%d\t%s\t%s\n", id, app_id,
+        x, y, width, height, *output ? output : "-", ws_x, ws_y,
+        flags.c_str(), title);
+}
+
+static void receive_committed_geometry(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t serial, uint32_t id,
+    int32_t x, int32_t y, int32_t width, int32_t height)
+{
+    printf("%u\t%d,%d %dx%d\n", id, x, y, width, height);
+}
+
+static void receive_view_mapped(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t id, const char *app_id,
+    const char *title)
+{
+    printf("mapped %u\t%s\t%s\n", id, app_id, title);
+    fflush(stdout);
+}
+
+static void receive_view_unmapped(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t id)
+{
+    printf("unmapped %u\n", id);
+    fflush(stdout);
+}
+
+static void receive_view_geometry(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t id, int32_t x, int32_t y,
+    int32_t width, int32_t height)
+{
+    printf("geometry %u\t%d,%d %dx%d\n", id, x, y, width, height);
+    fflush(stdout);
+}
+
+static void receive_view_focused(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t id)
+{
+    printf("focused %u\n", id);
+    fflush(stdout);
+}
+
+static void receive_workspace_changed(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, const char *output, int32_t ws_x, int32_t ws_y)
+{
+    printf("workspace %s\t%d,%d\n", output, ws_x, ws_y);
+    fflush(stdout);
+}
+
+static void receive_latency(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t serial, const char *request,
+    uint32_t stage, uint32_t count, uint32_t p50, uint32_t p90, uint32_t p99,
+    uint32_t max, struct wl_array *histogram)
+{
+    WfCtrl *wfm = (WfCtrl *) data;
+    static const char *stages[] = {"apply", "commit", "frame"};
+
+    printf("%s\t%s\t%u\t%.3f %.3f %.3f %.3f\n", request,
+        (stage < 3) ? stages[stage] : "?", count,
+        p50 / 1000.0, p90 / 1000.0, p99 / 1000.0, max / 1000.0);
+    if (!wfm->print_histograms)
+    {
+        return;
+    }
+
+    uint32_t *bucket;
+    int n = 0;
+    wl_array_for_each(bucket, histogram)
+    {
+        if (*bucket)
+        {
+            printf("\t<%uus %u\n", 2u << n, *bucket);
+        }
+
+        n++;
+    }
 }
 
+static void receive_queue_stats(void *data,
+    struct wf_ctrl_base *wf_ctrl_base, uint32_t serial, uint32_t depth,
+    uint32_t max_depth, uint32_t throttled, uint32_t dispatched)
+{
+    printf("queued %u (max %u)\tthrottled %u\tdispatched %u\n",
+        depth, max_depth, throttled, dispatched);
+}
 
 static struct wf_ctrl_base_listener control_base_listener {
 	.ack = receive_ack,
+	.done = receive_done,
+	.view_info = receive_view_info,
+	.view_mapped = receive_view_mapped,
+	.view_unmapped = receive_view_unmapped,
+	.view_geometry = receive_view_geometry,
+	.view_focused = receive_view_focused,
+	.workspace_changed = receive_workspace_changed,
+	.committed_geometry = receive_committed_geometry,
+	.latency = receive_latency,
+	.queue_stats = receive_queue_stats,
 };
 
 static void print_help()
 {
 }
 
-void WfCtrl::run()
+void WfCtrl::request_sent(bool reply)
 {
-    running = 1;
-    while(running)
-        wl_display_dispatch(display);
+    serial++;
+    if (reply)
+    {
+        in_flight++;
+    }
+}
+
+/* Parse a numeric input event code, if the compositor takes those */
+bool WfCtrl::parse_code(const char *arg, uint32_t& code)
+{
+    if ((wf_ctrl_base_get_version(wf_control_manager) <
+         WF_CTRL_BASE_KEYSTROKE_CODE_SINCE_VERSION) || !isdigit(*arg))
+    {
+        return false;
+    }
+
+    char *end;
+    code = strtoul(arg, &end, 0);
+    return *end == '\0';
+}
+
+int64_t now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Send everything queued so far in one go, then wait until every
+ * request has been answered or the timeout expires.
+ */
+bool WfCtrl::wait()
+{
+    struct pollfd fd;
+    fd.fd     = wl_display_get_fd(display);
+    fd.events = POLLIN;
+
+    int64_t deadline = now_ms() + timeout;
 
+    running = 1;
     wl_display_flush(display);
+    while (running && (in_flight > 0))
+    {
+        while (wl_display_prepare_read(display) != 0)
+        {
+            wl_display_dispatch_pending(display);
+        }
+
+        if (in_flight == 0)
+        {
+            wl_display_cancel_read(display);
+            break;
+        }
+
+        wl_display_flush(display);
+
+        int wait = timeout < 0 ? -1 : std::max<int64_t>(0, deadline - now_ms());
+        int ret  = poll(&fd, 1, wait);
+        if (ret <= 0)
+        {
+            wl_display_cancel_read(display);
+            if ((ret < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            if (ret == 0)
+            {
+                std::cerr << "Timed out waiting for " << in_flight << " replies" << std::endl;
+            }
+
+            exit_status = 1;
+            return false;
+        }
+
+        if ((wl_display_read_events(display) < 0) ||
+            (wl_display_dispatch_pending(display) < 0))
+        {
+            std::cerr << "Lost connection to the compositor" << std::endl;
+            exit_status = 1;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int signal)
+{
+    stop_requested = 1;
+}
+
+/* Handle events until SIGINT or SIGTERM, false if the connection is lost */
+bool WfCtrl::dispatch_until_interrupted()
+{
+    /* No SA_RESTART, so the signal interrupts poll */
+    struct sigaction sa = {};
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    struct pollfd fd;
+    fd.fd     = wl_display_get_fd(display);
+    fd.events = POLLIN;
+
+    while (!stop_requested)
+    {
+        if ((poll(&fd, 1, -1) > 0) && (wl_display_dispatch(display) < 0))
+        {
+            std::cerr << "Lost connection to the compositor" << std::endl;
+            exit_status = 1;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void WfCtrl::run()
+{
+    wait();
     wl_display_disconnect(display);
 }
 
 WfCtrl::WfCtrl(int argc, char *argv[])
 {
+    if ((argc > 2) && !strcmp(argv[1], "--timeout"))
+    {
+        timeout = atoi(argv[2]);
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc < 2)
     {
         print_help();
         return;
     }
 
+    exit_status = 1;
+
     display = wl_display_connect(NULL);
     if (!display)
     {
@@ -117,27 +405,104 @@ WfCtrl::WfCtrl(int argc, char *argv[])
 
     wf_ctrl_base_add_listener(wf_control_manager,
         &control_base_listener, this);
+    exit_status = 0;
 
-    if (!strcmp(argv[1], "key"))
+    if (!strcmp(argv[1], "--stdin"))
     {
-        do_key(this, argc, argv);
+        do_stdin(this, (argc > 2) && !strcmp(argv[2], "--coalesce"));
         return;
     }
+
+    if (send_command(argc, argv))
+    {
+        run();
+    }
+    else
+    {
+        exit_status = 1;
+    }
+}
+
+/* By their wf_ctrl_base layout_kind value */
+static const char *layout_names[] = {"grid", "columns", "rows", "master-stack"};
+
+bool WfCtrl::send_command(int argc, char *argv[])
+{
+    /* Fully reset getopt, commands may be parsed more than once */
+    optind = 0;
+
+    if (!strcmp(argv[1], "key"))
+    {
+        return do_key(this, argc, argv);
+    }
     else if (!strcmp(argv[1], "button"))
     {
-        do_button(this, argc, argv);
-        return;
+        return do_button(this, argc, argv);
     }
     else if (!strcmp(argv[1], "mousemove"))
     {
-        do_mousemove(this, argc, argv);
-        return;
+        return do_mousemove(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "list"))
+    {
+        wf_ctrl_base_list_views(wf_control_manager);
+        request_sent();
+        return true;
+    }
+    else if (!strcmp(argv[1], "wait"))
+    {
+        return do_wait(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "watch"))
+    {
+        return do_watch(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "stats"))
+    {
+        return do_stats(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "save-layout"))
+    {
+        return do_save_layout(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "restore-layout"))
+    {
+        return do_restore_layout(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "scroll"))
+    {
+        return do_scroll(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "touch"))
+    {
+        return do_touch(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "replay"))
+    {
+        return do_replay(this, argc, argv);
+    }
+    else if (!strcmp(argv[1], "record"))
+    {
+        return do_record(this, argc, argv);
     }
 
     std::vector<int> view_ids;
     int request_mask = 0;
     int x, y, w, h, ws_x, ws_y;
     char *direction = NULL;
+    /* Outputs to switch the workspace of, NULL for the active one */
+    const char *ws_output = NULL;
+    /* Where --move puts views, the output and workspace they are on if unset */
+    const char *to_output = NULL;
+    int to_ws_x = -1, to_ws_y = -1;
+    /* Layout to arrange all views in, negative for none */
+    int layout = -1, gap = 0;
+    /* Criteria for the plugin to select views by */
+    bool select = false;
+    const char *app_id = "", *title = "", *output = "";
+    int sel_ws_x = -1, sel_ws_y = -1;
+    /* Milliseconds to wait for views to commit, negative to not wait */
+    int commit_timeout = -1;
 
     struct option opts[] = {
         { "view-id",     required_argument, NULL, 'i' },
@@ -150,11 +515,21 @@ WfCtrl::WfCtrl(int argc, char *argv[])
         { "focus",       no_argument,       NULL, 'f' },
         { "close",       no_argument,       NULL, 'c' },
         { "switch-ws",   required_argument, NULL, 'w' },
+        { "app-id",      required_argument, NULL, 'a' },
+        { "title",       required_argument, NULL, 't' },
+        { "output",      required_argument, NULL, 'o' },
+        { "on-ws",       required_argument, NULL, 'W' },
+        { "wait-commit", required_argument, NULL, 'C' },
+        { "ws-output",   required_argument, NULL, 'O' },
+        { "to-output",   required_argument, NULL, 'T' },
+        { "to-ws",       required_argument, NULL, 'S' },
+        { "layout",      required_argument, NULL, 'L' },
+        { "gap",         required_argument, NULL, 'g' },
         { 0,             0,                 NULL,  0  }
     };
 
     int c, i;
-    while((c = getopt_long(argc, argv, "i:m:r:XxnNfcw:", opts, &i)) != -1)
+    while((c = getopt_long(argc, argv, "i:m:r:XxnNfcw:a:t:o:W:C:O:T:S:L:g:", opts, &i)) != -1)
     {
         switch(c)
         {
@@ -204,30 +579,234 @@ WfCtrl::WfCtrl(int argc, char *argv[])
                 request_mask |= REQUEST_WS_SWITCH;
                 break;
 
+            case 'a':
+                app_id = optarg;
+                select = true;
+                break;
+
+            case 't':
+                title  = optarg;
+                select = true;
+                break;
+
+            case 'o':
+                output = optarg;
+                select = true;
+                break;
+
+            case 'W':
+                if (sscanf(optarg, "%d,%d", &sel_ws_x, &sel_ws_y) != 2)
+                {
+                    printf("Invalid workspace %s\n", optarg);
+                    return false;
+                }
+                select = true;
+                break;
+
+            case 'C':
+                commit_timeout = atoi(optarg);
+                break;
+
+            case 'O':
+                ws_output = optarg;
+                break;
+
+            case 'T':
+                to_output = optarg;
+                break;
+
+            case 'S':
+                if (sscanf(optarg, "%d,%d", &to_ws_x, &to_ws_y) != 2)
+                {
+                    printf("Invalid workspace %s\n", optarg);
+                    return false;
+                }
+                break;
+
+            case 'L':
+                for (int k = 0; k < 4; k++)
+                {
+                    if (!strcmp(optarg, layout_names[k]))
+                    {
+                        layout = k;
+                    }
+                }
+
+                if (layout < 0)
+                {
+                    printf("Unknown layout %s\n", optarg);
+                    return false;
+                }
+                break;
+
+            case 'g':
+                gap = atoi(optarg);
+                break;
+
             default:
                 printf("Unsupported command line argument %s\n", optarg);
-                return;
+                return false;
         }
     }
 
+    if (select)
+    {
+        if (wf_ctrl_base_get_version(wf_control_manager) <
+            WF_CTRL_BASE_SET_SELECTOR_SINCE_VERSION)
+        {
+            printf("The compositor cannot select views\n");
+            return false;
+        }
+
+        /* The plugin resolves view ID -2 to the matching views */
+        wf_ctrl_base_set_selector(wf_control_manager, app_id, title, output,
+            sel_ws_x, sel_ws_y);
+        request_sent();
+        view_ids.push_back(-2);
+    }
+
+    if (commit_timeout >= 0)
+    {
+        if (wf_ctrl_base_get_version(wf_control_manager) <
+            WF_CTRL_BASE_SET_ACK_MODE_SINCE_VERSION)
+        {
+            printf("The compositor cannot wait for commits\n");
+            return false;
+        }
+
+        wf_ctrl_base_set_ack_mode(wf_control_manager,
+            WF_CTRL_BASE_ACK_MODE_COMMIT, commit_timeout);
+        request_sent();
+    }
+
+    /*
+     * Position and size go together, so the view gets a single configure.
+     * Older compositors get a move and a resize.
+     */
+    bool set_geometry = (request_mask & REQUEST_MOVE) &&
+        ((request_mask & REQUEST_RESIZE) || to_output || (to_ws_x >= 0));
+    if ((to_ws_x >= 0) && !(request_mask & REQUEST_MOVE))
+    {
+        printf("--to-ws needs --move\n");
+        return false;
+    }
+
+    if (to_output && !(request_mask & REQUEST_MOVE) && (layout < 0))
+    {
+        printf("--to-output needs --move or --layout\n");
+        return false;
+    }
+
+    if ((to_output || (to_ws_x >= 0)) && (request_mask & REQUEST_MOVE) &&
+        (wf_ctrl_base_get_version(wf_control_manager) <
+         WF_CTRL_BASE_SET_GEOMETRY_SINCE_VERSION))
+    {
+        printf("The compositor cannot move views to an output or workspace\n");
+        return false;
+    }
+
+    if (wf_ctrl_base_get_version(wf_control_manager) <
+        WF_CTRL_BASE_SET_GEOMETRY_SINCE_VERSION)
+    {
+        set_geometry = false;
+    }
+
+    if ((layout >= 0) &&
+        (wf_ctrl_base_get_version(wf_control_manager) <
+         WF_CTRL_BASE_LAYOUT_SINCE_VERSION))
+    {
+        printf("The compositor cannot arrange views\n");
+        return false;
+    }
+
+    /*
+     * Apply the changes to all views at once if the compositor can. A
+     * layout alone is a single request already and needs no transaction.
+     */
+    bool batched = request_mask & (REQUEST_MOVE | REQUEST_RESIZE | REQUEST_MAXIMIZE |
+        REQUEST_UNMAXIMIZE | REQUEST_MINIMIZE | REQUEST_UNMINIMIZE);
+    bool transaction = batched && (view_ids.size() > 1 || select) &&
+        wf_ctrl_base_get_version(wf_control_manager) >= WF_CTRL_BASE_BEGIN_SINCE_VERSION;
+
+    if (transaction)
+    {
+        wf_ctrl_base_begin(wf_control_manager);
+        request_sent();
+    }
+
     for (auto view_id : view_ids)
     {
-        if (request_mask & REQUEST_MOVE)
+        if (set_geometry)
+        {
+            /* Without --resize, the size stays */
+            bool resize = request_mask & REQUEST_RESIZE;
+            wf_ctrl_base_set_geometry(wf_control_manager, view_id, x, y,
+                resize ? w : 0, resize ? h : 0, to_output ? to_output : "",
+                to_ws_x, to_ws_y);
+            request_sent(!transaction);
+        }
+        else if (request_mask & REQUEST_MOVE)
+        {
             wf_ctrl_base_move(wf_control_manager, view_id, x, y);
-        if (request_mask & REQUEST_RESIZE)
+            request_sent(!transaction);
+        }
+        if ((request_mask & REQUEST_RESIZE) && !set_geometry)
+        {
             wf_ctrl_base_resize(wf_control_manager, view_id, w, h);
+            request_sent(!transaction);
+        }
         if (request_mask & REQUEST_MAXIMIZE)
+        {
             wf_ctrl_base_maximize(wf_control_manager, view_id);
+            request_sent(!transaction);
+        }
         if (request_mask & REQUEST_UNMAXIMIZE)
+        {
             wf_ctrl_base_unmaximize(wf_control_manager, view_id);
+            request_sent(!transaction);
+        }
         if (request_mask & REQUEST_MINIMIZE)
+        {
             wf_ctrl_base_minimize(wf_control_manager, view_id);
+            request_sent(!transaction);
+        }
         if (request_mask & REQUEST_UNMINIMIZE)
+        {
             wf_ctrl_base_unminimize(wf_control_manager, view_id);
+            request_sent(!transaction);
+        }
         if (request_mask & REQUEST_FOCUS)
+        {
             wf_ctrl_base_focus(wf_control_manager, view_id);
+            request_sent();
+        }
         if (request_mask & REQUEST_CLOSE)
+        {
             wf_ctrl_base_close(wf_control_manager, view_id);
+            request_sent();
+        }
+    }
+
+    if (transaction)
+    {
+        wf_ctrl_base_commit(wf_control_manager);
+        request_sent();
+    }
+
+    if (layout >= 0)
+    {
+        /* One request for all views, arranged in the order given */
+        wl_array ids;
+        wl_array_init(&ids);
+        for (auto view_id : view_ids)
+        {
+            *(int32_t*)wl_array_add(&ids, sizeof(int32_t)) = view_id;
+        }
+
+        wf_ctrl_base_layout(wf_control_manager, layout, &ids,
+            to_output ? to_output : "", gap);
+        wl_array_release(&ids);
+        request_sent();
     }
 
     if (request_mask & REQUEST_WS_SWITCH)
@@ -235,8 +814,29 @@ WfCtrl::WfCtrl(int argc, char *argv[])
         for (auto view_id : view_ids)
         {
             wf_ctrl_base_ws_switch_view_append(wf_control_manager, view_id);
+            /* Only acknowledged since version 2 */
+            request_sent(wf_ctrl_base_get_version(wf_control_manager) >=
+                WF_CTRL_BASE_DONE_SINCE_VERSION);
+        }
+        if (ws_output)
+        {
+            if (wf_ctrl_base_get_version(wf_control_manager) <
+                WF_CTRL_BASE_WS_SWITCH_OUTPUT_SINCE_VERSION)
+            {
+                printf("The compositor cannot switch workspaces by output\n");
+                return false;
+            }
+
+            if (direction)
+            {
+                wf_ctrl_base_ws_switch_output(wf_control_manager, ws_output, direction);
+            }
+            else
+            {
+                wf_ctrl_base_ws_switch_abs_output(wf_control_manager, ws_output, ws_x, ws_y);
+            }
         }
-        if (direction)
+        else if (direction)
         {
             wf_ctrl_base_ws_switch(wf_control_manager, direction);
         }
@@ -244,9 +844,10 @@ WfCtrl::WfCtrl(int argc, char *argv[])
         {
             wf_ctrl_base_ws_switch_abs(wf_control_manager, ws_x, ws_y);
         }
+        request_sent();
     }
 
-    run();
+    return true;
 }
 
 WfCtrl::~WfCtrl()
@@ -255,7 +856,7 @@ WfCtrl::~WfCtrl()
 
 int main(int argc, char *argv[])
 {
-    WfCtrl(argc, argv);
+    WfCtrl ctrl(argc, argv);
 
-    return 0;
+    return ctrl.exit_status;
 }
@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include <deque>
 #include "wayfire-control-client-protocol.h"
 
 #define REQUEST_MOVE       1 << 1
@@ -46,9 +47,55 @@ class WfCtrl
     wl_display *display;
     wf_ctrl_base *wf_control_manager;
     int running;
+    /* Serial of the last request sent */
+    uint32_t serial = 0;
+    /* Requests still waiting for their reply */
+    uint32_t in_flight = 0;
+    /* Milliseconds to wait for replies, negative to wait forever */
+    int timeout = -1;
+    int exit_status = 0;
+    void request_sent(bool reply = true);
+    bool parse_code(const char *arg, uint32_t& code);
+    bool wait();
+    bool dispatch_until_interrupted();
     void run();
+    bool send_command(int argc, char *argv[]);
+
+    /* A command read in --stdin mode, waiting for its replies */
+    struct command_t
+    {
+        int line;
+        /* Serials of the requests it sent, and replies still to come */
+        uint32_t first_serial;
+        uint32_t last_serial;
+        uint32_t outstanding;
+        uint32_t status;
+        /* When it times out, in now_ms() milliseconds */
+        int64_t deadline;
+    };
+
+    /* Print the latency histograms along with stats */
+    bool print_histograms = false;
+
+    bool stdin_mode = false;
+    std::deque<command_t> commands;
+    void command_done(uint32_t serial, uint32_t status);
 };
 
-void do_key(WfCtrl *, int argc, char *argv[]);
-void do_button(WfCtrl *, int argc, char *argv[]);
-void do_mousemove(WfCtrl *, int argc, char *argv[]);
+const char *status_to_string(uint32_t status);
+/* Milliseconds of the monotonic clock */
+int64_t now_ms();
+
+bool do_key(WfCtrl *, int argc, char *argv[]);
+bool do_button(WfCtrl *, int argc, char *argv[]);
+bool do_mousemove(WfCtrl *, int argc, char *argv[]);
+bool do_scroll(WfCtrl *, int argc, char *argv[]);
+bool do_touch(WfCtrl *, int argc, char *argv[]);
+bool do_wait(WfCtrl *, int argc, char *argv[]);
+bool do_watch(WfCtrl *, int argc, char *argv[]);
+bool do_stats(WfCtrl *, int argc, char *argv[]);
+bool do_save_layout(WfCtrl *, int argc, char *argv[]);
+bool do_restore_layout(WfCtrl *, int argc, char *argv[]);
+bool do_replay(WfCtrl *, int argc, char *argv[]);
+bool do_record(WfCtrl *, int argc, char *argv[]);
+void do_stdin(WfCtrl *, bool coalesce);
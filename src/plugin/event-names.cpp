@@ -0,0 +1,88 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include <cstring>
+#include <linux/input-event-codes.h>
+
+extern "C"
+{
+#include <libevdev/libevdev.h>
+}
+
+#include "event-names.hpp"
+
+wayfire_control_event_names::wayfire_control_event_names()
+{
+    for (int code = 0; code <= KEY_MAX; code++)
+    {
+        const char *name = libevdev_event_code_get_name(EV_KEY, code);
+        if (!name)
+        {
+            continue;
+        }
+
+        if (!strncmp(name, "KEY_", 4))
+        {
+            key_names[name + 4] = code;
+        }
+        else if (!strncmp(name, "BTN_", 4))
+        {
+            button_names[name + 4] = code;
+        }
+    }
+}
+
+/*
+ * Names missing from the tables are aliases of other codes, those go
+ * through libevdev with the name built on the stack.
+ */
+static int code_from_name(const std::unordered_map<std::string_view, uint32_t>& names,
+    const char *prefix, const char *name)
+{
+    auto it = names.find(name);
+    if (it != names.end())
+    {
+        return it->second;
+    }
+
+    char full_name[64];
+    if (snprintf(full_name, sizeof(full_name), "%s%s", prefix, name) >= int(sizeof(full_name)))
+    {
+        return -1;
+    }
+
+    return libevdev_event_code_from_name(EV_KEY, full_name);
+}
+
+int wayfire_control_event_names::key_from_name(const char *name) const
+{
+    return code_from_name(key_names, "KEY_", name);
+}
+
+int wayfire_control_event_names::button_from_name(const char *name) const
+{
+    return code_from_name(button_names, "BTN_", name);
+}
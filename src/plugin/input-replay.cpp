@@ -0,0 +1,524 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cstdio>
+#include <cerrno>
+#include <cstdarg>
+#include <cstring>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <wayfire/core.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/plugin.hpp>
+#include <wayfire/signal-definitions.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+#include <linux/input-event-codes.h>
+
+#include "input-replay.hpp"
+#include "wayfire-control-server-protocol.h"
+
+/* How far ahead of playback a script is read */
+static const size_t MAX_QUEUED_EVENTS = 1024;
+/* How much of a recording is kept while its reader does not keep up */
+static const size_t MAX_PENDING_OUTPUT = 1 << 20;
+
+static int handle_replay_readable(int fd, uint32_t mask, void *data)
+{
+    ((wayfire_control_replay*)data)->handle_readable();
+    return 0;
+}
+
+static int handle_replay_timer(int fd, uint32_t mask, void *data)
+{
+    ((wayfire_control_replay*)data)->handle_timer();
+    return 0;
+}
+
+wayfire_control_replay::wayfire_control_replay(wayfire_control *ctrl, int fd,
+    wayfire_control_reply reply)
+{
+    this->ctrl  = ctrl;
+    this->reply = reply;
+    this->fd    = fd;
+    last_time   = monotonic_us();
+
+    auto loop = wf::get_core().ev_loop;
+    timer_fd     = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    timer_source = wl_event_loop_add_fd(loop, timer_fd, WL_EVENT_READABLE,
+        handle_replay_timer, this);
+
+    /* Regular files cannot be polled, those are read as playback goes */
+    read_source = wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+        handle_replay_readable, this);
+    if (!read_source)
+    {
+        handle_readable();
+    }
+}
+
+wayfire_control_replay::~wayfire_control_replay()
+{
+    if (is_active())
+    {
+        finish(WF_CTRL_BASE_STATUS_OK);
+    }
+}
+
+bool wayfire_control_replay::is_active() const
+{
+    return fd >= 0;
+}
+
+bool wayfire_control_replay::parse_line(const std::string& line)
+{
+    const char *text = line.c_str();
+    while (isspace(*text))
+    {
+        text++;
+    }
+
+    if (!*text || (*text == '#'))
+    {
+        return true;
+    }
+
+    long long delay;
+    char type[16];
+    int len;
+    if ((sscanf(text, "%lld %15s %n", &delay, type, &len) < 2) || (delay < 0))
+    {
+        return false;
+    }
+
+    const char *args = text + len;
+    event_t event;
+    event.time = last_time + delay;
+
+    int pressed;
+    char orientation[16];
+    if (!strcmp(type, "key") || !strcmp(type, "button"))
+    {
+        event.type = strcmp(type, "key") ? event_t::BUTTON : event_t::KEY;
+        if ((sscanf(args, "%u %d", &event.code, &pressed) != 2) || (event.code > KEY_MAX))
+        {
+            return false;
+        }
+
+        event.pressed = pressed;
+    }
+    else if (!strcmp(type, "motion") || !strcmp(type, "motion_absolute"))
+    {
+        event.type = strcmp(type, "motion") ? event_t::MOTION_ABSOLUTE : event_t::MOTION;
+        if (sscanf(args, "%lf %lf", &event.x, &event.y) != 2)
+        {
+            return false;
+        }
+    }
+    else if (!strcmp(type, "axis"))
+    {
+        event.type = event_t::AXIS;
+        if (sscanf(args, "%15s %lf %d", orientation, &event.x, &event.discrete) != 3)
+        {
+            return false;
+        }
+
+        if (!strcmp(orientation, "vertical"))
+        {
+            event.orientation = WLR_AXIS_ORIENTATION_VERTICAL;
+        }
+        else if (!strcmp(orientation, "horizontal"))
+        {
+            event.orientation = WLR_AXIS_ORIENTATION_HORIZONTAL;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    last_time = event.time;
+    events.push_back(event);
+    return true;
+}
+
+/* Read and parse input until enough events are queued. False on bad input */
+bool wayfire_control_replay::read_input()
+{
+    char data[4096];
+
+    while (!eof && (events.size() < MAX_QUEUED_EVENTS))
+    {
+        ssize_t len = read_nonblocking(fd, data, sizeof(data));
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN)
+            {
+                break;
+            }
+
+            return false;
+        }
+
+        if (len == 0)
+        {
+            eof = true;
+        }
+        else
+        {
+            buffer.append(data, len);
+        }
+
+        size_t pos;
+        while ((pos = buffer.find('\n')) != std::string::npos)
+        {
+            if (!parse_line(buffer.substr(0, pos)))
+            {
+                return false;
+            }
+
+            buffer.erase(0, pos + 1);
+        }
+
+        if (eof && !buffer.empty())
+        {
+            if (!parse_line(buffer))
+            {
+                return false;
+            }
+
+            buffer.clear();
+        }
+    }
+
+    return true;
+}
+
+/* Stop reading while plenty of events are queued */
+void wayfire_control_replay::throttle_input()
+{
+    if (!read_source)
+    {
+        return;
+    }
+
+    bool want_input = !eof && (events.size() < MAX_QUEUED_EVENTS);
+    wl_event_source_fd_update(read_source, want_input ? WL_EVENT_READABLE : 0);
+}
+
+void wayfire_control_replay::schedule()
+{
+    struct itimerspec spec = {};
+    if (!events.empty())
+    {
+        spec.it_value.tv_sec  = events.front().time / 1000000;
+        spec.it_value.tv_nsec = events.front().time % 1000000 * 1000;
+    }
+
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void wayfire_control_replay::inject(const event_t& event)
+{
+    switch (event.type)
+    {
+      case event_t::KEY:
+        ctrl->key_event(event.code, event.pressed ?
+            WL_KEYBOARD_KEY_STATE_PRESSED : WL_KEYBOARD_KEY_STATE_RELEASED);
+        break;
+
+      case event_t::BUTTON:
+        ctrl->button_event(event.code, event.pressed ?
+            WLR_BUTTON_PRESSED : WLR_BUTTON_RELEASED);
+        break;
+
+      case event_t::MOTION:
+        ctrl->motion_event(event.x, event.y);
+        break;
+
+      case event_t::MOTION_ABSOLUTE:
+        ctrl->motion_absolute_event(event.x, event.y);
+        break;
+
+      case event_t::AXIS:
+        ctrl->axis_event(event.orientation, event.x, event.discrete);
+        break;
+    }
+}
+
+void wayfire_control_replay::handle_readable()
+{
+    if (!read_input())
+    {
+        finish(WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    throttle_input();
+    schedule();
+    if (eof && events.empty())
+    {
+        finish(WF_CTRL_BASE_STATUS_OK);
+    }
+}
+
+void wayfire_control_replay::handle_timer()
+{
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+    {
+        /* Spurious wakeup, the timer was re-armed in between */
+    }
+
+    int64_t now = monotonic_us();
+    while (!events.empty() && (events.front().time <= now))
+    {
+        inject(events.front());
+        events.pop_front();
+    }
+
+    if (!read_source)
+    {
+        handle_readable();
+        return;
+    }
+
+    throttle_input();
+    schedule();
+    if (eof && events.empty())
+    {
+        finish(WF_CTRL_BASE_STATUS_OK);
+    }
+}
+
+void wayfire_control_replay::finish(uint32_t status)
+{
+    if (read_source)
+    {
+        wl_event_source_remove(read_source);
+        read_source = nullptr;
+    }
+
+    wl_event_source_remove(timer_source);
+    timer_source = nullptr;
+    close(timer_fd);
+    timer_fd = -1;
+    close(fd);
+    fd = -1;
+
+    events.clear();
+    reply.send(status);
+}
+
+static int handle_recorder_writable(int fd, uint32_t mask, void *data)
+{
+    ((wayfire_control_recorder*)data)->flush();
+    return 0;
+}
+
+/* The event of an input signal, or null if our own devices sent it */
+template<class T>
+static T *real_event(wayfire_control *ctrl, wf::signal_data_t *data)
+{
+    auto signal = static_cast<wf::input_event_signal<T>*>(data);
+    if ((signal->device == &ctrl->pointer.base) || (signal->device == &ctrl->keyboard.base))
+    {
+        return nullptr;
+    }
+
+    return signal->event;
+}
+
+wayfire_control_recorder::wayfire_control_recorder(wayfire_control *ctrl, int fd)
+{
+    this->ctrl = ctrl;
+    this->fd   = fd;
+    last_time = monotonic_us();
+
+    on_key.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto ev = real_event<wlr_keyboard_key_event>(ctrl, data);
+        if (!ev)
+        {
+            return;
+        }
+
+        write_event("key %u %d", ev->keycode, ev->state == WL_KEYBOARD_KEY_STATE_PRESSED);
+    });
+    on_button.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto ev = real_event<wlr_pointer_button_event>(ctrl, data);
+        if (!ev)
+        {
+            return;
+        }
+
+        write_event("button %u %d", ev->button, ev->state == WLR_BUTTON_PRESSED);
+    });
+    on_motion.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto ev = real_event<wlr_pointer_motion_event>(ctrl, data);
+        if (!ev)
+        {
+            return;
+        }
+
+        write_event("motion %f %f", ev->delta_x, ev->delta_y);
+    });
+    on_motion_absolute.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto ev = real_event<wlr_pointer_motion_absolute_event>(ctrl, data);
+        if (!ev)
+        {
+            return;
+        }
+
+        /* Devices not mapped to an output cover the box around the layout */
+        wlr_box box;
+        wlr_output_layout_get_box(wf::get_core().output_layout->get_handle(), NULL, &box);
+        write_event("motion_absolute %f %f",
+            box.x + ev->x * box.width, box.y + ev->y * box.height);
+    });
+    on_axis.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto ev = real_event<wlr_pointer_axis_event>(ctrl, data);
+        if (!ev)
+        {
+            return;
+        }
+
+        write_event("axis %s %f %d",
+            ev->orientation == WLR_AXIS_ORIENTATION_VERTICAL ? "vertical" : "horizontal",
+            ev->delta, ev->delta_discrete);
+    });
+
+    auto& core = wf::get_core();
+    core.connect_signal("keyboard_key", &on_key);
+    core.connect_signal("pointer_button", &on_button);
+    core.connect_signal("pointer_motion", &on_motion);
+    core.connect_signal("pointer_motion_absolute", &on_motion_absolute);
+    core.connect_signal("pointer_axis", &on_axis);
+}
+
+wayfire_control_recorder::~wayfire_control_recorder()
+{
+    on_key.disconnect();
+    on_button.disconnect();
+    on_motion.disconnect();
+    on_motion_absolute.disconnect();
+    on_axis.disconnect();
+
+    flush();
+    if (write_source)
+    {
+        wl_event_source_remove(write_source);
+    }
+
+    close(fd);
+}
+
+/*
+ * Events that come while too much is waiting for the reader are dropped,
+ * and a comment says how many once there is room again
+ */
+void wayfire_control_recorder::write_event(const char *fmt, ...)
+{
+    if (pending.size() >= MAX_PENDING_OUTPUT)
+    {
+        dropped++;
+        return;
+    }
+
+    if (dropped)
+    {
+        pending += "# " + std::to_string(dropped) + " events dropped\n";
+        dropped = 0;
+    }
+
+    int64_t now = monotonic_us();
+    long long delay = now - last_time;
+    last_time = now;
+
+    char line[128];
+    int len = snprintf(line, sizeof(line), "%lld ", delay);
+
+    va_list args;
+    va_start(args, fmt);
+    len += vsnprintf(line + len, sizeof(line) - len, fmt, args);
+    va_end(args);
+
+    pending.append(line, std::min<size_t>(len, sizeof(line) - 1));
+    pending.push_back('\n');
+    if (!write_source)
+    {
+        flush();
+    }
+}
+
+/* Write out what we can without blocking, the rest once the fd is writable */
+void wayfire_control_recorder::flush()
+{
+    while (!pending.empty())
+    {
+        ssize_t len = write_nosigpipe(fd, pending.data(), pending.size());
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if ((errno == EAGAIN) && !write_source)
+            {
+                write_source = wl_event_loop_add_fd(wf::get_core().ev_loop, fd,
+                    WL_EVENT_WRITABLE, handle_recorder_writable, this);
+            }
+
+            if (errno != EAGAIN)
+            {
+                /* Nobody is reading anymore */
+                pending.clear();
+            }
+
+            break;
+        }
+
+        pending.erase(0, len);
+    }
+
+    if (pending.empty() && write_source)
+    {
+        wl_event_source_remove(write_source);
+        write_source = nullptr;
+    }
+}
@@ -0,0 +1,132 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <deque>
+#include <string>
+#include <wayfire/object.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+
+#include "wayfire-control.hpp"
+
+/*
+ * Input scripts are text, one event per line:
+ *
+ *   <delay> key <code> <pressed>
+ *   <delay> button <code> <pressed>
+ *   <delay> motion <dx> <dy>
+ *   <delay> motion_absolute <x> <y>
+ *   <delay> axis <vertical|horizontal> <delta> <discrete>
+ *
+ * The delay is in microseconds, relative to the previous event, or to the
+ * start of the replay for the first one. Absolute motion is in layout
+ * coordinates. Discrete axis steps are in 120ths of a wheel click. Empty
+ * lines and lines starting with # are ignored.
+ */
+
+/* Plays back a script read from a file descriptor */
+class wayfire_control_replay
+{
+  public:
+    wayfire_control_replay(wayfire_control *ctrl, int fd,
+        wayfire_control_reply reply);
+    ~wayfire_control_replay();
+
+    bool is_active() const;
+
+    void handle_readable();
+    void handle_timer();
+
+  private:
+    struct event_t
+    {
+        enum type_t
+        {
+            KEY,
+            BUTTON,
+            MOTION,
+            MOTION_ABSOLUTE,
+            AXIS,
+        };
+
+        type_t type;
+        int64_t time;
+        uint32_t code;
+        bool pressed;
+        double x, y;
+        wlr_axis_orientation orientation;
+        int32_t discrete;
+    };
+
+    wayfire_control *ctrl;
+    wayfire_control_reply reply;
+
+    int fd;
+    wl_event_source *read_source = nullptr;
+    bool eof = false;
+    std::string buffer;
+
+    /* Parsed events not injected yet, and the time of the last one */
+    std::deque<event_t> events;
+    int64_t last_time;
+
+    int timer_fd = -1;
+    wl_event_source *timer_source = nullptr;
+
+    bool read_input();
+    bool parse_line(const std::string& line);
+    void inject(const event_t& event);
+    void schedule();
+    void throttle_input();
+    void finish(uint32_t status);
+};
+
+/* Writes real input to a file descriptor in the script format */
+class wayfire_control_recorder
+{
+  public:
+    wayfire_control_recorder(wayfire_control *ctrl, int fd);
+    ~wayfire_control_recorder();
+
+    void flush();
+
+  private:
+    wayfire_control *ctrl;
+    int fd;
+    /* Events not written yet, and those dropped since it was full */
+    std::string pending;
+    uint64_t dropped = 0;
+    wl_event_source *write_source = nullptr;
+    int64_t last_time;
+
+    wf::signal_connection_t on_key;
+    wf::signal_connection_t on_button;
+    wf::signal_connection_t on_motion;
+    wf::signal_connection_t on_motion_absolute;
+    wf::signal_connection_t on_axis;
+
+    void write_event(const char *fmt, ...);
+};
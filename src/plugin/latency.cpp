@@ -0,0 +1,340 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
+#include <wayfire/output.hpp>
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+/*
+ * Samples not done this long after their answer, or after their receipt
+ * if never answered, are recorded with the stages they reached
+ */
+static const int64_t SAMPLE_TIMEOUT_US     = 1000000;
+static const int64_t UNANSWERED_TIMEOUT_US = 60000000;
+/* Histogram buckets, bucket n counting latencies below 2^(n + 1)us */
+static const int LATENCY_BUCKETS = 24;
+
+/* Called for each request on receipt, returns the ID of its sample */
+uint64_t wayfire_control::begin_sample(const char *request)
+{
+    expire_samples();
+
+    wayfire_control_sample sample;
+    sample.id = ++last_sample_id;
+    sample.request = request;
+    sample.receipt = monotonic_us();
+    open_samples.emplace(sample.id, std::move(sample));
+    unanswered_samples.insert(last_sample_id);
+    return last_sample_id;
+}
+
+static wayfire_control_sample *find_sample(
+    std::unordered_map<uint64_t, wayfire_control_sample>& samples, uint64_t id)
+{
+    auto it = samples.find(id);
+    return it != samples.end() ? &it->second : nullptr;
+}
+
+/* The sample @id also waits for @views to commit, called before applying */
+void wayfire_control::sample_views(uint64_t id, const std::vector<wayfire_view>& views)
+{
+    auto sample = find_sample(open_samples, id);
+    if (!sample)
+    {
+        return;
+    }
+
+    for (auto& view : views)
+    {
+        if (std::find(sample->views.begin(), sample->views.end(),
+            view->get_id()) == sample->views.end())
+        {
+            sample->views.push_back(view->get_id());
+            commit_samples[view->get_id()].push_back(id);
+        }
+    }
+}
+
+/* Sample @id waits for the next frame of its output */
+void wayfire_control::wait_sample_frame(wayfire_control_sample& sample)
+{
+    auto& waiting = frame_samples[sample.output];
+    if (waiting.empty())
+    {
+        hook_frames(sample.output, false);
+    }
+
+    waiting.push_back(sample.id);
+}
+
+/*
+ * The request of sample @id has been answered. Its result shows in the
+ * next frame once its views have committed, or right away without views.
+ * Frames are only watched for, never scheduled: anything visible a
+ * request does asks for its own frame.
+ */
+void wayfire_control::end_sample(uint64_t id)
+{
+    auto sample = find_sample(open_samples, id);
+    if (!sample || sample->apply)
+    {
+        return;
+    }
+
+    sample->apply = monotonic_us();
+    unanswered_samples.erase(id);
+    answered_samples.push_back(id);
+    if (!sample->views.empty())
+    {
+        return;
+    }
+
+    if (!sample->commit)
+    {
+        sample->output = wf::get_core().get_active_output();
+    }
+
+    if (sample->output)
+    {
+        wait_sample_frame(*sample);
+    }
+}
+
+/* Called when @view has committed a new geometry */
+void wayfire_control::sample_commit(wayfire_view view)
+{
+    auto pending = commit_samples.find(view->get_id());
+    if (pending == commit_samples.end())
+    {
+        return;
+    }
+
+    auto ids = std::move(pending->second);
+    commit_samples.erase(pending);
+    for (auto id : ids)
+    {
+        auto sample = find_sample(open_samples, id);
+        if (!sample)
+        {
+            continue;
+        }
+
+        auto it = std::find(sample->views.begin(), sample->views.end(), view->get_id());
+        if (it == sample->views.end())
+        {
+            continue;
+        }
+
+        sample->views.erase(it);
+        if (sample->views.empty())
+        {
+            sample->commit = monotonic_us();
+            sample->output = view->get_output();
+            if (sample->apply && sample->output)
+            {
+                wait_sample_frame(*sample);
+            }
+        }
+    }
+}
+
+/* Called after each frame @output renders while frames are hooked */
+void wayfire_control::sample_frame(wf::output_t *output)
+{
+    auto waiting = frame_samples.find(output);
+    if (waiting == frame_samples.end())
+    {
+        return;
+    }
+
+    int64_t now = monotonic_us();
+    auto ids = std::move(waiting->second);
+    frame_samples.erase(waiting);
+    for (auto id : ids)
+    {
+        auto sample = find_sample(open_samples, id);
+        if (sample && (sample->output == output))
+        {
+            sample->frame = now;
+            close_sample(id);
+        }
+    }
+}
+
+/*
+ * Answered samples expire in the order they were answered, unanswered ones
+ * in the order they were received, so only the oldest of each are looked at
+ */
+void wayfire_control::expire_samples()
+{
+    int64_t now = monotonic_us();
+    while (!answered_samples.empty())
+    {
+        auto sample = find_sample(open_samples, answered_samples.front());
+        if (sample && (now - sample->apply <= SAMPLE_TIMEOUT_US))
+        {
+            break;
+        }
+
+        if (sample)
+        {
+            close_sample(sample->id);
+        }
+
+        answered_samples.pop_front();
+    }
+
+    while (!unanswered_samples.empty())
+    {
+        uint64_t id = *unanswered_samples.begin();
+        auto sample = find_sample(open_samples, id);
+        if (sample && (now - sample->receipt <= UNANSWERED_TIMEOUT_US))
+        {
+            break;
+        }
+
+        unanswered_samples.erase(unanswered_samples.begin());
+        if (sample)
+        {
+            close_sample(id);
+        }
+    }
+}
+
+/* Record the open sample @id with the stages it reached */
+void wayfire_control::close_sample(uint64_t id)
+{
+    auto it = open_samples.find(id);
+    for (auto view_id : it->second.views)
+    {
+        auto pending = commit_samples.find(view_id);
+        if (pending == commit_samples.end())
+        {
+            continue;
+        }
+
+        auto& ids = pending->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        if (ids.empty())
+        {
+            commit_samples.erase(pending);
+        }
+    }
+
+    unanswered_samples.erase(id);
+    record_sample(it->second);
+    open_samples.erase(it);
+}
+
+void wayfire_control::record_sample(wayfire_control_sample& sample)
+{
+    sample.views.clear();
+    sample.output = nullptr;
+    if (sample_ring.size() < SAMPLE_RING_SIZE)
+    {
+        sample_ring.push_back(std::move(sample));
+        return;
+    }
+
+    sample_ring[next_sample] = std::move(sample);
+    next_sample = (next_sample + 1) % SAMPLE_RING_SIZE;
+}
+
+static void send_latency(wayfire_control_client *cl, const char *request,
+    uint32_t stage, std::vector<int64_t>& latencies)
+{
+    if (latencies.empty())
+    {
+        return;
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&] (size_t p)
+    {
+        return uint32_t(latencies[(latencies.size() - 1) * p / 100]);
+    };
+
+    wl_array histogram;
+    wl_array_init(&histogram);
+    auto buckets = (uint32_t*)wl_array_add(&histogram, LATENCY_BUCKETS * sizeof(uint32_t));
+    std::fill(buckets, buckets + LATENCY_BUCKETS, 0);
+    for (auto latency : latencies)
+    {
+        int bucket = 0;
+        while ((bucket < LATENCY_BUCKETS - 1) && (latency >= (int64_t(2) << bucket)))
+        {
+            bucket++;
+        }
+
+        buckets[bucket]++;
+    }
+
+    wf_ctrl_base_send_latency(cl->resource, cl->serial, request, stage,
+        latencies.size(), percentile(50), percentile(90), percentile(99),
+        latencies.back(), &histogram);
+    wl_array_release(&histogram);
+}
+
+/* Send the latencies of the requests in the ring, by request and stage */
+void wayfire_control::send_stats(wayfire_control_client *cl)
+{
+    expire_samples();
+
+    std::map<std::string_view, std::vector<const wayfire_control_sample*>> by_request;
+    for (auto& sample : sample_ring)
+    {
+        by_request[sample.request].push_back(&sample);
+    }
+
+    for (auto& [request, samples] : by_request)
+    {
+        std::vector<int64_t> apply, commit, frame;
+        for (auto sample : samples)
+        {
+            if (sample->apply)
+            {
+                apply.push_back(sample->apply - sample->receipt);
+            }
+
+            if (sample->commit)
+            {
+                commit.push_back(sample->commit - sample->receipt);
+            }
+
+            if (sample->frame)
+            {
+                frame.push_back(sample->frame - sample->receipt);
+            }
+        }
+
+        send_latency(cl, samples[0]->request, WF_CTRL_BASE_LATENCY_STAGE_APPLY, apply);
+        send_latency(cl, samples[0]->request, WF_CTRL_BASE_LATENCY_STAGE_COMMIT, commit);
+        send_latency(cl, samples[0]->request, WF_CTRL_BASE_LATENCY_STAGE_FRAME, frame);
+    }
+}
@@ -0,0 +1,121 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cmath>
+#include <algorithm>
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+/* @count cells splitting @length into equal parts with @gap between them */
+static std::vector<std::pair<int, int>> split(int start, int length, int count, int gap)
+{
+    std::vector<std::pair<int, int>> cells;
+    int available = length - gap * (count - 1);
+    for (int i = 0; i < count; i++)
+    {
+        /* Rounding is spread over the cells so they end on the edge */
+        int begin = start + available * i / count + gap * i;
+        int end   = start + available * (i + 1) / count + gap * i;
+        cells.push_back({begin, end - begin});
+    }
+
+    return cells;
+}
+
+/* Rows of @count views, @per_row in each but the last, which takes the rest */
+static void add_rows(std::vector<wf::geometry_t>& geometries, wf::geometry_t area,
+    int count, int per_row, int gap)
+{
+    int rows = (count + per_row - 1) / per_row;
+    auto row_cells = split(area.y, area.height, rows, gap);
+    for (int row = 0; row < rows; row++)
+    {
+        int in_row = std::min(per_row, count - row * per_row);
+        for (auto& [x, width] : split(area.x, area.width, in_row, gap))
+        {
+            geometries.push_back({x, row_cells[row].first, width, row_cells[row].second});
+        }
+    }
+}
+
+/*
+ * Geometries of @count views arranged by @kind, a wf_ctrl_base layout_kind,
+ * in @workarea with @gap pixels between views and around them. Empty for
+ * an unknown kind, or if the views would not fit.
+ */
+std::vector<wf::geometry_t> wayfire_control_layout(uint32_t kind,
+    wf::geometry_t workarea, int count, int gap)
+{
+    std::vector<wf::geometry_t> geometries;
+    wf::geometry_t area = {workarea.x + gap, workarea.y + gap,
+        workarea.width - 2 * gap, workarea.height - 2 * gap};
+
+    switch (kind)
+    {
+      case WF_CTRL_BASE_LAYOUT_KIND_GRID:
+        add_rows(geometries, area, count, std::ceil(std::sqrt(count)), gap);
+        break;
+
+      case WF_CTRL_BASE_LAYOUT_KIND_COLUMNS:
+        add_rows(geometries, area, count, count, gap);
+        break;
+
+      case WF_CTRL_BASE_LAYOUT_KIND_ROWS:
+        add_rows(geometries, area, count, 1, gap);
+        break;
+
+      case WF_CTRL_BASE_LAYOUT_KIND_MASTER_STACK:
+      {
+        if (count == 1)
+        {
+            geometries.push_back(area);
+            break;
+        }
+
+        /* The first view takes the left half, the others share the right */
+        auto halves = split(area.x, area.width, 2, gap);
+        geometries.push_back({halves[0].first, area.y, halves[0].second, area.height});
+        add_rows(geometries, {halves[1].first, area.y, halves[1].second, area.height},
+            count - 1, 1, gap);
+        break;
+      }
+
+      default:
+        return {};
+    }
+
+    for (auto& geometry : geometries)
+    {
+        if ((geometry.width <= 0) || (geometry.height <= 0))
+        {
+            return {};
+        }
+    }
+
+    return geometries;
+}
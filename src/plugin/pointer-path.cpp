@@ -0,0 +1,127 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cmath>
+#include <algorithm>
+#include <wayfire/core.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+static wf::pointf_t lerp(const wf::pointf_t& a, const wf::pointf_t& b, double t)
+{
+    return {a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t};
+}
+
+/* The point at @t of the polyline's length, so the speed is constant */
+static wf::pointf_t polyline_at(const std::vector<wf::pointf_t>& points, double t)
+{
+    double total = 0;
+    for (size_t i = 1; i < points.size(); i++)
+    {
+        total += std::hypot(points[i].x - points[i - 1].x, points[i].y - points[i - 1].y);
+    }
+
+    double distance = t * total;
+    for (size_t i = 1; i < points.size(); i++)
+    {
+        double length = std::hypot(points[i].x - points[i - 1].x,
+            points[i].y - points[i - 1].y);
+        if ((length > 0) && (distance <= length))
+        {
+            return lerp(points[i - 1], points[i], distance / length);
+        }
+
+        distance -= length;
+    }
+
+    return points.back();
+}
+
+/* De Casteljau's algorithm, with all the points as control points */
+static wf::pointf_t bezier_at(std::vector<wf::pointf_t> points, double t)
+{
+    for (size_t n = points.size() - 1; n > 0; n--)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            points[i] = lerp(points[i], points[i + 1], t);
+        }
+    }
+
+    return points[0];
+}
+
+/*
+ * Move the pointer to where the oldest path is by now, and schedule the
+ * next move a frame later. Each move goes to a point computed from the
+ * elapsed time rather than adding up steps, so a late timer does not slow
+ * the path down and the last move lands exactly on the end point.
+ */
+void wayfire_control::run_paths()
+{
+    auto& core = wf::get_core();
+
+    while (!paths.empty())
+    {
+        auto& path  = paths.front();
+        int64_t now = monotonic_us() / 1000;
+        if (path.start < 0)
+        {
+            /* Paths start wherever the previous one left the pointer */
+            path.points.insert(path.points.begin(), core.get_cursor_position());
+            path.start = now;
+        }
+
+        double t = path.duration ?
+            std::min(1.0, double(now - path.start) / path.duration) : 1.0;
+        wf::pointf_t target;
+        if (t >= 1.0)
+        {
+            target = path.points.back();
+        }
+        else if (path.bezier)
+        {
+            target = bezier_at(path.points, t);
+        }
+        else
+        {
+            target = polyline_at(path.points, t);
+        }
+
+        motion_absolute_event(target.x, target.y);
+
+        if (t >= 1.0)
+        {
+            path.reply.send(WF_CTRL_BASE_STATUS_OK);
+            paths.pop_front();
+            continue;
+        }
+
+        wl_event_source_timer_update(path_timer, frame_interval_us() / 1000);
+        return;
+    }
+}
@@ -0,0 +1,230 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <unistd.h>
+#include <cctype>
+#include <algorithm>
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
+#include <wayfire/output.hpp>
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+wayfire_control_request::wayfire_control_request(uint32_t opcode, uint64_t sample,
+    const wl_message *message, const wl_argument *args) :
+    opcode(opcode), sample(sample)
+{
+    /* Keep the type of each argument, without versions or nullability */
+    for (const char *c = message->signature; *c; c++)
+    {
+        if (!isdigit(*c) && (*c != '?'))
+        {
+            types.push_back(*c);
+        }
+    }
+
+    for (size_t i = 0; i < types.size(); i++)
+    {
+        this->args.push_back(args[i]);
+        switch (types[i])
+        {
+          case 's':
+            strings.emplace_back(args[i].s ? args[i].s : "");
+            break;
+
+          case 'a':
+            if (args[i].a)
+            {
+                auto data = (const char*)args[i].a->data;
+                arrays.emplace_back(data, data + args[i].a->size);
+            }
+            else
+            {
+                arrays.emplace_back();
+            }
+
+            break;
+        }
+    }
+}
+
+wayfire_control_request::~wayfire_control_request()
+{
+    if (handed_over)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (types[i] == 'h')
+        {
+            close(args[i].h);
+        }
+    }
+}
+
+std::vector<wl_argument> wayfire_control_request::arguments(std::vector<wl_array>& storage)
+{
+    std::vector<wl_argument> out = args;
+    size_t string = 0, array = 0;
+
+    storage.resize(arrays.size());
+    for (size_t i = 0; i < out.size(); i++)
+    {
+        switch (types[i])
+        {
+          case 's':
+            /* Null strings stay null */
+            if (out[i].s)
+            {
+                out[i].s = strings[string].c_str();
+            }
+
+            string++;
+            break;
+
+          case 'a':
+            if (out[i].a)
+            {
+                storage[array].size  = arrays[array].size();
+                storage[array].alloc = arrays[array].size();
+                storage[array].data  = arrays[array].data();
+                out[i].a = &storage[array];
+            }
+
+            array++;
+            break;
+        }
+    }
+
+    handed_over = true;
+    return out;
+}
+
+/* Whether requests can still run in the current frame */
+bool wayfire_control::budget_left()
+{
+    if (frame_budget <= 0)
+    {
+        return true;
+    }
+
+    int64_t now = monotonic_us();
+    if (now - budget_window >= frame_interval_us())
+    {
+        budget_window = now;
+        budget_spent  = 0;
+    }
+
+    return budget_spent < frame_budget;
+}
+
+/* Run a request now, charging the time it takes to the frame budget */
+void wayfire_control::run_request(wayfire_control_client *cl, uint32_t opcode,
+    uint64_t sample, const wl_argument *args)
+{
+    /* The handler could drop the last reference to its client */
+    auto keep = cl->shared_from_this();
+    int64_t start = monotonic_us();
+
+    cl->sample = sample;
+    cl->dispatched++;
+    wayfire_control_invoke(cl->resource, opcode, args);
+    budget_spent += monotonic_us() - start;
+}
+
+void wayfire_control::queue_request(wayfire_control_client *cl,
+    wayfire_control_request request)
+{
+    if ((queue_limit > 0) && (cl->queue.size() >= (size_t)(int)queue_limit))
+    {
+        wl_resource_post_error(cl->resource, WF_CTRL_BASE_ERROR_QUEUE_FULL,
+            "more than %d requests waiting", (int)queue_limit);
+        return;
+    }
+
+    cl->queue.push_back(std::move(request));
+    cl->throttled++;
+    cl->max_queue_depth = std::max(cl->max_queue_depth, cl->queue.size());
+    arm_queue_timer();
+}
+
+/* Wake up when the next frame's budget starts */
+void wayfire_control::arm_queue_timer()
+{
+    if (queue_timer_armed)
+    {
+        return;
+    }
+
+    int64_t left = budget_window + frame_interval_us() - monotonic_us();
+    queue_timer_armed = true;
+    wl_event_source_timer_update(queue_timer,
+        std::max<int64_t>(1, (left + 999) / 1000));
+}
+
+/* Drain the queues round-robin, one request per client in turn */
+void wayfire_control::run_queues()
+{
+    queue_timer_armed = false;
+    while (budget_left())
+    {
+        size_t count = clients.size();
+        size_t n = 0;
+        for (; n < count; n++)
+        {
+            if (!clients[(next_queue + n) % count]->queue.empty())
+            {
+                break;
+            }
+        }
+
+        if (n == count)
+        {
+            return;
+        }
+
+        auto cl = clients[(next_queue + n) % count];
+        next_queue = (next_queue + n + 1) % count;
+
+        auto request = std::move(cl->queue.front());
+        cl->queue.pop_front();
+
+        std::vector<wl_array> arrays;
+        auto args = request.arguments(arrays);
+        run_request(cl.get(), request.opcode, request.sample, args.data());
+    }
+
+    arm_queue_timer();
+}
+
+/* Send the queue counters of @cl, in reply to stats */
+void wayfire_control::send_queue_stats(wayfire_control_client *cl)
+{
+    wf_ctrl_base_send_queue_stats(cl->resource, cl->serial, cl->queue.size(),
+        cl->max_queue_depth, cl->throttled, cl->dispatched);
+}
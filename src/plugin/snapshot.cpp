@@ -0,0 +1,351 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <algorithm>
+#include <sstream>
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/workspace-manager.hpp>
+
+#include "snapshot.hpp"
+#include "wayfire-control-server-protocol.h"
+
+/* Larger snapshots are refused */
+static const size_t MAX_SNAPSHOT_SIZE = 16 << 20;
+
+static int handle_snapshot_fd(int fd, uint32_t mask, void *data)
+{
+    ((wayfire_control_snapshot*)data)->handle_fd();
+    return 0;
+}
+
+wayfire_control_snapshot::wayfire_control_snapshot(int fd, std::string data,
+    wayfire_control_reply reply)
+{
+    this->fd      = fd;
+    this->writing = true;
+    this->data    = std::move(data);
+    this->reply   = reply;
+    start();
+}
+
+wayfire_control_snapshot::wayfire_control_snapshot(int fd,
+    wayfire_control_reply reply, std::function<void(const std::string&)> done)
+{
+    this->fd      = fd;
+    this->writing = false;
+    this->reply   = reply;
+    this->done    = done;
+    start();
+}
+
+wayfire_control_snapshot::~wayfire_control_snapshot()
+{
+    if (source)
+    {
+        wl_event_source_remove(source);
+    }
+
+    if (active)
+    {
+        close(fd);
+    }
+}
+
+bool wayfire_control_snapshot::is_active() const
+{
+    return active;
+}
+
+void wayfire_control_snapshot::start()
+{
+    bool failed = false;
+    if (!transfer(failed))
+    {
+        finish(failed);
+        return;
+    }
+
+    /* Regular files never get here, they are never short of data or room */
+    source = wl_event_loop_add_fd(wf::get_core().ev_loop, fd,
+        writing ? WL_EVENT_WRITABLE : WL_EVENT_READABLE, handle_snapshot_fd, this);
+    if (!source)
+    {
+        finish(true);
+    }
+}
+
+void wayfire_control_snapshot::handle_fd()
+{
+    bool failed = false;
+    if (!transfer(failed))
+    {
+        finish(failed);
+    }
+}
+
+bool wayfire_control_snapshot::transfer(bool& failed)
+{
+    char buffer[4096];
+
+    while (!writing || !data.empty())
+    {
+        ssize_t len = writing ? write_nosigpipe(fd, data.data(), data.size()) :
+            read_nonblocking(fd, buffer, sizeof(buffer));
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            failed = (errno != EAGAIN);
+            return !failed;
+        }
+
+        if (writing)
+        {
+            data.erase(0, len);
+            continue;
+        }
+
+        if ((len == 0) || (data.size() + len > MAX_SNAPSHOT_SIZE))
+        {
+            failed = (len != 0);
+            return false;
+        }
+
+        data.append(buffer, len);
+    }
+
+    return false;
+}
+
+void wayfire_control_snapshot::finish(bool failed)
+{
+    if (source)
+    {
+        wl_event_source_remove(source);
+        source = nullptr;
+    }
+
+    close(fd);
+    active = false;
+
+    if (failed || writing)
+    {
+        reply.send(failed ? WF_CTRL_BASE_STATUS_INVALID_ARGUMENT : WF_CTRL_BASE_STATUS_OK);
+        return;
+    }
+
+    done(data);
+}
+
+/* Views worth saving, in a stable order */
+static std::vector<wayfire_view> snapshot_views(wayfire_control *ctrl)
+{
+    std::vector<wayfire_view> result;
+    for (auto& [id, view] : ctrl->views)
+    {
+        if ((view->role == wf::VIEW_ROLE_TOPLEVEL) && view->get_output())
+        {
+            result.push_back(view);
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [] (wayfire_view a, wayfire_view b)
+    {
+        return a->get_id() < b->get_id();
+    });
+    return result;
+}
+
+static std::string snapshot_field(std::string text)
+{
+    std::replace_if(text.begin(), text.end(),
+        [] (char c) { return (c == '\t') || (c == '\n') || (c == '\r'); }, ' ');
+    return text;
+}
+
+/*
+ * Tiled views are saved with their tiled geometry, their geometry from
+ * before tiling being known only to whatever tiled them
+ */
+std::string wayfire_control::save_layout()
+{
+    std::string data = "# app_id\toutput\tworkspace\tposition\tsize\ttiled\tminimized\ttitle\n";
+
+    for (auto& view : snapshot_views(this))
+    {
+        auto output = view->get_output();
+        auto ws     = output->workspace->get_view_main_workspace(view);
+        auto current = output->workspace->get_current_workspace();
+        auto size   = output->get_screen_size();
+        auto geometry = view->get_wm_geometry();
+
+        char fields[128];
+        snprintf(fields, sizeof(fields), "%d,%d\t%d,%d\t%dx%d\t%u\t%d", ws.x, ws.y,
+            geometry.x - (ws.x - current.x) * size.width,
+            geometry.y - (ws.y - current.y) * size.height,
+            geometry.width, geometry.height, view->tiled_edges, (int)view->minimized);
+        data += snapshot_field(view->get_app_id()) + "\t" + output->handle->name + "\t" +
+            fields + "\t" + snapshot_field(view->get_title()) + "\n";
+    }
+
+    return data;
+}
+
+/*
+ * Operations giving views back what @data saved. Entries match views with
+ * the same app ID and title first, then views with the same app ID, so
+ * views whose title changed are found too. Returns a wf_ctrl_base status.
+ */
+uint32_t wayfire_control::restore_layout(const std::string& data,
+    std::vector<wayfire_control_op>& ops)
+{
+    struct entry_t
+    {
+        std::string app_id, output, title;
+        wf::point_t workspace;
+        wf::geometry_t geometry;
+        uint32_t tiled;
+        int minimized;
+        wayfire_view view = nullptr;
+    };
+
+    std::vector<entry_t> entries;
+    std::istringstream lines(data);
+    std::string line;
+    while (std::getline(lines, line))
+    {
+        if (line.empty() || (line[0] == '#'))
+        {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::istringstream split(line);
+        std::string field;
+        while ((fields.size() < 7) && std::getline(split, field, '\t'))
+        {
+            fields.push_back(field);
+        }
+
+        /* The title is the rest of the line, maybe empty */
+        field.clear();
+        std::getline(split, field);
+        fields.push_back(field);
+
+        entry_t entry;
+        if ((fields.size() != 8) ||
+            (sscanf(fields[2].c_str(), "%d,%d", &entry.workspace.x, &entry.workspace.y) != 2) ||
+            (sscanf(fields[3].c_str(), "%d,%d", &entry.geometry.x, &entry.geometry.y) != 2) ||
+            (sscanf(fields[4].c_str(), "%dx%d", &entry.geometry.width,
+                &entry.geometry.height) != 2) ||
+            (sscanf(fields[5].c_str(), "%u", &entry.tiled) != 1) ||
+            (sscanf(fields[6].c_str(), "%d", &entry.minimized) != 1))
+        {
+            return WF_CTRL_BASE_STATUS_INVALID_ARGUMENT;
+        }
+
+        entry.app_id = fields[0];
+        entry.output = fields[1];
+        entry.title  = fields[7];
+        entries.push_back(std::move(entry));
+    }
+
+    auto candidates = snapshot_views(this);
+    for (bool by_title : {true, false})
+    {
+        for (auto& entry : entries)
+        {
+            auto it = std::find_if(candidates.begin(), candidates.end(), [&] (auto view)
+            {
+                return !entry.view && (view->get_app_id() == entry.app_id) &&
+                       (!by_title || (view->get_title() == entry.title));
+            });
+            if (it != candidates.end())
+            {
+                entry.view = *it;
+                candidates.erase(it);
+            }
+        }
+    }
+
+    for (auto& entry : entries)
+    {
+        if (!entry.view)
+        {
+            continue;
+        }
+
+        /* Outputs and workspaces that are gone leave the view where it is */
+        int32_t id  = entry.view->get_id();
+        auto output = wf::get_core().output_layout->find_output(entry.output);
+        wf::dimensions_t grid = {0, 0};
+        if (output)
+        {
+            grid = output->workspace->get_workspace_grid_size();
+        }
+
+        if ((entry.workspace.x >= 0) && (entry.workspace.y >= 0) &&
+            (entry.workspace.x < grid.width) && (entry.workspace.y < grid.height))
+        {
+            if (entry.view->tiled_edges && !entry.tiled)
+            {
+                ops.push_back({wayfire_control_op::TILE, id});
+            }
+
+            wayfire_control_op op{wayfire_control_op::SET_GEOMETRY, id};
+            op.x = entry.geometry.x;
+            op.y = entry.geometry.y;
+            op.w = entry.geometry.width;
+            op.h = entry.geometry.height;
+            op.output    = entry.output;
+            op.workspace = entry.workspace;
+            ops.push_back(op);
+
+            if (entry.tiled)
+            {
+                op = {wayfire_control_op::TILE, id};
+                op.edges = entry.tiled;
+                ops.push_back(op);
+            }
+        }
+
+        if ((entry.minimized != 0) != entry.view->minimized)
+        {
+            ops.push_back({entry.minimized ?
+                wayfire_control_op::MINIMIZE : wayfire_control_op::UNMINIMIZE, id});
+        }
+    }
+
+    return ops.empty() ? WF_CTRL_BASE_STATUS_NO_VIEW : WF_CTRL_BASE_STATUS_OK;
+}
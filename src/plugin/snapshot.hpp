@@ -0,0 +1,74 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <functional>
+#include <string>
+
+#include "wayfire-control.hpp"
+
+/*
+ * Layout snapshots are text, one view per line with tab separated fields:
+ *
+ *   <app_id> <output> <ws_x>,<ws_y> <x>,<y> <width>x<height> <tiled> <minimized> <title>
+ *
+ * The position is relative to the view's workspace, tiled holds the tiled
+ * edges and minimized is 0 or 1. Tabs and newlines in app IDs and titles
+ * are saved as spaces. Empty lines and lines starting with # are ignored.
+ */
+
+/* Writes a snapshot to, or reads one from, a file descriptor */
+class wayfire_control_snapshot
+{
+  public:
+    /* Write @data, then answer with @reply */
+    wayfire_control_snapshot(int fd, std::string data, wayfire_control_reply reply);
+    /*
+     * Read up to the end, then hand the data to @done, which answers
+     * @reply. It is answered with invalid_argument if reading fails.
+     */
+    wayfire_control_snapshot(int fd, wayfire_control_reply reply,
+        std::function<void(const std::string&)> done);
+    ~wayfire_control_snapshot();
+
+    bool is_active() const;
+
+    void handle_fd();
+
+  private:
+    int fd;
+    bool writing;
+    bool active = true;
+    std::string data;
+    wl_event_source *source = nullptr;
+    wayfire_control_reply reply;
+    std::function<void(const std::string&)> done;
+
+    void start();
+    /* False once the fd is done with, one way or the other */
+    bool transfer(bool& failed);
+    void finish(bool failed);
+};
@@ -0,0 +1,270 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <wayfire/core.hpp>
+#include <wayfire/plugin.hpp>
+#include <wayfire/nonstd/wlroots-full.hpp>
+#include <xkbcommon/xkbcommon.h>
+
+extern "C"
+{
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_keyboard.h>
+}
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+/* Keys pressed to get a modifier, by the real modifier they set */
+static const struct
+{
+    const char *name;
+    xkb_keysym_t keysym;
+} modifier_keys[] = {
+    {XKB_MOD_NAME_SHIFT, XKB_KEY_Shift_L},
+    {XKB_MOD_NAME_CTRL, XKB_KEY_Control_L},
+    {XKB_MOD_NAME_ALT, XKB_KEY_Alt_L},
+    {"Mod5", XKB_KEY_ISO_Level3_Shift},
+    {"Mod3", XKB_KEY_ISO_Level5_Shift},
+};
+
+/* Decode the next UTF-8 character of @text, advancing it */
+static bool next_codepoint(const char*& text, uint32_t& codepoint)
+{
+    auto s = (const unsigned char*)text;
+    int len;
+
+    if (s[0] < 0x80)
+    {
+        codepoint = s[0];
+        len = 1;
+    }
+    else if ((s[0] & 0xe0) == 0xc0)
+    {
+        codepoint = s[0] & 0x1f;
+        len = 2;
+    }
+    else if ((s[0] & 0xf0) == 0xe0)
+    {
+        codepoint = s[0] & 0x0f;
+        len = 3;
+    }
+    else if ((s[0] & 0xf8) == 0xf0)
+    {
+        codepoint = s[0] & 0x07;
+        len = 4;
+    }
+    else
+    {
+        return false;
+    }
+
+    for (int i = 1; i < len; i++)
+    {
+        if ((s[i] & 0xc0) != 0x80)
+        {
+            return false;
+        }
+
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+
+    text += len;
+    return true;
+}
+
+xkb_keymap *wayfire_control::get_keymap()
+{
+    /*
+     * Type with the layout of the keyboard currently in use on the seat,
+     * followed on each request so layout changes are picked up
+     */
+    auto seat_keyboard = wlr_seat_get_keyboard(wf::get_core().get_current_seat());
+    if (seat_keyboard && (seat_keyboard != &keyboard) && seat_keyboard->keymap &&
+        (seat_keyboard->keymap != keyboard.keymap))
+    {
+        wlr_keyboard_set_keymap(&keyboard, seat_keyboard->keymap);
+    }
+
+    return keyboard.keymap;
+}
+
+void wayfire_control::update_keysym_keys(xkb_keymap *keymap)
+{
+    if (keymap == keysym_keymap)
+    {
+        return;
+    }
+
+    if (keysym_keymap)
+    {
+        xkb_keymap_unref(keysym_keymap);
+    }
+
+    keysym_keymap = xkb_keymap_ref(keymap);
+    keysym_keys.clear();
+
+    xkb_keycode_t min = xkb_keymap_min_keycode(keymap);
+    xkb_keycode_t max = xkb_keymap_max_keycode(keymap);
+    for (xkb_keycode_t key = min; key <= max; key++)
+    {
+        xkb_level_index_t levels = xkb_keymap_num_levels_for_key(keymap, key, 0);
+        for (xkb_level_index_t level = 0; level < levels; level++)
+        {
+            const xkb_keysym_t *syms;
+            if (xkb_keymap_key_get_syms_by_level(keymap, key, 0, level, &syms) != 1)
+            {
+                continue;
+            }
+
+            xkb_mod_mask_t masks[4];
+            size_t num_masks = xkb_keymap_key_get_mods_for_level(keymap, key, 0,
+                level, masks, 4);
+            if (num_masks == 0)
+            {
+                continue;
+            }
+
+            /* Prefer the way that needs the fewest modifiers held */
+            xkb_mod_mask_t mask = *std::min_element(masks, masks + num_masks,
+                [] (xkb_mod_mask_t a, xkb_mod_mask_t b)
+            {
+                return __builtin_popcount(a) < __builtin_popcount(b);
+            });
+
+            auto it = keysym_keys.find(syms[0]);
+            if ((it == keysym_keys.end()) ||
+                (__builtin_popcount(mask) < __builtin_popcount(it->second.modifiers)))
+            {
+                /* xkb keycodes are evdev keycodes offset by 8 */
+                keysym_keys[syms[0]] = {key - 8, mask};
+            }
+        }
+    }
+}
+
+bool wayfire_control::translate_text(const char *text, std::vector<typed_char_t>& chars)
+{
+    xkb_keymap *keymap = get_keymap();
+    if (!keymap)
+    {
+        return false;
+    }
+
+    update_keysym_keys(keymap);
+
+    uint32_t codepoint;
+    while (*text)
+    {
+        if (!next_codepoint(text, codepoint))
+        {
+            return false;
+        }
+
+        xkb_keysym_t keysym = (codepoint == '\n') ?
+            XKB_KEY_Return : xkb_utf32_to_keysym(codepoint);
+        auto it = keysym_keys.find(keysym);
+        if ((keysym == XKB_KEY_NoSymbol) || (it == keysym_keys.end()))
+        {
+            return false;
+        }
+
+        typed_char_t c;
+        c.keycode = it->second.keycode;
+
+        xkb_mod_mask_t mask = it->second.modifiers;
+        for (auto& mod : modifier_keys)
+        {
+            xkb_mod_index_t index = xkb_keymap_mod_get_index(keymap, mod.name);
+            if ((index == XKB_MOD_INVALID) || !(mask & (1u << index)))
+            {
+                continue;
+            }
+
+            auto key = keysym_keys.find(mod.keysym);
+            if ((key == keysym_keys.end()) || key->second.modifiers)
+            {
+                continue;
+            }
+
+            c.modifiers.push_back(key->second.keycode);
+            mask &= ~(1u << index);
+        }
+
+        if (mask)
+        {
+            /* Needs a modifier we have no key for */
+            return false;
+        }
+
+        chars.push_back(c);
+    }
+
+    return true;
+}
+
+void wayfire_control::type_char(const typed_char_t& c)
+{
+    for (auto modifier : c.modifiers)
+    {
+        key_event(modifier, WL_KEYBOARD_KEY_STATE_PRESSED);
+    }
+
+    key_event(c.keycode, WL_KEYBOARD_KEY_STATE_PRESSED);
+    key_event(c.keycode, WL_KEYBOARD_KEY_STATE_RELEASED);
+
+    for (auto it = c.modifiers.rbegin(); it != c.modifiers.rend(); ++it)
+    {
+        key_event(*it, WL_KEYBOARD_KEY_STATE_RELEASED);
+    }
+}
+
+/*
+ * Type the next character of the oldest text and schedule the one after
+ * it. Requests are typed one after the other, each is answered once its
+ * last character has been typed.
+ */
+void wayfire_control::run_typing()
+{
+    while (!typing.empty())
+    {
+        auto& job = typing.front();
+        type_char(job.chars[job.next++]);
+
+        if (job.next == job.chars.size())
+        {
+            job.reply.send(WF_CTRL_BASE_STATUS_OK);
+            typing.pop_front();
+            continue;
+        }
+
+        if (job.interval > 0)
+        {
+            wl_event_source_timer_update(typing_timer, job.interval);
+            return;
+        }
+    }
+}
@@ -0,0 +1,232 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/output-layout.hpp>
+#include <wayfire/workspace-manager.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/signal-definitions.hpp>
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+static int handle_events_timer(void *data)
+{
+    ((wayfire_control*)data)->flush_events();
+    return 0;
+}
+
+void wayfire_control::init_events()
+{
+    auto& core = wf::get_core();
+    events_timer = wl_event_loop_add_timer(core.ev_loop, handle_events_timer, this);
+
+    on_view_geometry_changed.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        queue_view_event(view->get_id(), WF_CTRL_BASE_EVENT_MASK_VIEW_GEOMETRY);
+        /* Before the waits, so samples of commit acks see the commit */
+        sample_commit(view);
+        check_waits(wayfire_control_wait::GEOMETRY);
+        check_waits(wayfire_control_wait::COMMIT);
+    });
+    on_focus_view.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        pending_focus = view ? view->get_id() : 0;
+        queue_event(WF_CTRL_BASE_EVENT_MASK_FOCUS);
+    });
+    on_workspace_changed.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto ev = static_cast<wf::workspace_changed_signal*>(data);
+        pending_workspaces[ev->output->handle->name] = ev->new_viewport;
+        queue_event(WF_CTRL_BASE_EVENT_MASK_WORKSPACE);
+    });
+    on_output_added.set_callback([=] (wf::signal_data_t *data)
+    {
+        connect_output_events(get_signaled_output(data));
+    });
+    on_output_removed.set_callback([=] (wf::signal_data_t *data)
+    {
+        output_removed(get_signaled_output(data));
+    });
+
+    for (auto output : core.output_layout->get_outputs())
+    {
+        connect_output_events(output);
+    }
+
+    core.output_layout->connect_signal("output-added", &on_output_added);
+    core.output_layout->connect_signal("output-pre-remove", &on_output_removed);
+    for (auto& [id, view] : views)
+    {
+        view->connect_signal("geometry-changed", &on_view_geometry_changed);
+    }
+}
+
+void wayfire_control::fini_events()
+{
+    on_view_geometry_changed.disconnect();
+    on_focus_view.disconnect();
+    on_workspace_changed.disconnect();
+    on_output_added.disconnect();
+    on_output_removed.disconnect();
+    wl_event_source_remove(events_timer);
+
+    waits.clear();
+    for (auto& [output, hook] : frame_hooks)
+    {
+        if (hook.active)
+        {
+            output->render->rem_effect(&hook.hook);
+        }
+    }
+}
+
+void wayfire_control::connect_output_events(wf::output_t *output)
+{
+    output->connect_signal("focus-view", &on_focus_view);
+    output->connect_signal("workspace-changed", &on_workspace_changed);
+}
+
+/* Called from the core map and unmap signals */
+void wayfire_control::view_mapped(wayfire_view view)
+{
+    view->connect_signal("geometry-changed", &on_view_geometry_changed);
+    queue_view_event(view->get_id(), WF_CTRL_BASE_EVENT_MASK_VIEW_MAPPED);
+    check_waits(wayfire_control_wait::VIEW_MAPPED);
+}
+
+void wayfire_control::view_unmapped(wayfire_view view)
+{
+    view->disconnect_signal(&on_view_geometry_changed);
+    queue_view_event(view->get_id(), WF_CTRL_BASE_EVENT_MASK_VIEW_UNMAPPED);
+
+    /* Waits on the view end with no_view */
+    check_waits(wayfire_control_wait::GEOMETRY);
+    check_waits(wayfire_control_wait::ANIMATION);
+    check_waits(wayfire_control_wait::COMMIT);
+}
+
+/* Events are only gathered while some client wants them */
+void wayfire_control::queue_event(uint32_t event)
+{
+    if (!(subscribed_events & event))
+    {
+        return;
+    }
+
+    if (!pending_events)
+    {
+        wl_event_source_timer_update(events_timer, frame_interval_us() / 1000);
+    }
+
+    pending_events |= event;
+}
+
+void wayfire_control::queue_view_event(uint32_t id, uint32_t event)
+{
+    if (subscribed_events & event)
+    {
+        pending_views[id] |= event;
+        queue_event(event);
+    }
+}
+
+void wayfire_control::update_subscriptions()
+{
+    subscribed_events = 0;
+    for (auto& cl : clients)
+    {
+        subscribed_events |= cl->event_mask;
+    }
+}
+
+/*
+ * Send what changed since the last frame. Each view gets at most one
+ * event of each kind, with its state as of now, and views that were
+ * mapped and unmapped again in between are left out.
+ */
+void wayfire_control::flush_events()
+{
+    const uint32_t map_unmap = WF_CTRL_BASE_EVENT_MASK_VIEW_MAPPED |
+        WF_CTRL_BASE_EVENT_MASK_VIEW_UNMAPPED;
+
+    for (auto& cl : clients)
+    {
+        if (!(cl->event_mask & pending_events))
+        {
+            continue;
+        }
+
+        for (auto& [id, events] : pending_views)
+        {
+            uint32_t wanted = events & cl->event_mask;
+            auto it = views.find(id);
+            if ((events & map_unmap) == map_unmap)
+            {
+                continue;
+            }
+
+            if ((it != views.end()) && (wanted & WF_CTRL_BASE_EVENT_MASK_VIEW_MAPPED))
+            {
+                wf_ctrl_base_send_view_mapped(cl->resource, id,
+                    it->second->get_app_id().c_str(), it->second->get_title().c_str());
+            }
+
+            if ((it != views.end()) && (wanted & WF_CTRL_BASE_EVENT_MASK_VIEW_GEOMETRY))
+            {
+                auto geometry = it->second->get_wm_geometry();
+                wf_ctrl_base_send_view_geometry(cl->resource, id,
+                    geometry.x, geometry.y, geometry.width, geometry.height);
+            }
+
+            if (wanted & WF_CTRL_BASE_EVENT_MASK_VIEW_UNMAPPED)
+            {
+                wf_ctrl_base_send_view_unmapped(cl->resource, id);
+            }
+        }
+
+        if (cl->event_mask & pending_events & WF_CTRL_BASE_EVENT_MASK_FOCUS)
+        {
+            wf_ctrl_base_send_view_focused(cl->resource, pending_focus);
+        }
+
+        if (cl->event_mask & pending_events & WF_CTRL_BASE_EVENT_MASK_WORKSPACE)
+        {
+            for (auto& [output, ws] : pending_workspaces)
+            {
+                wf_ctrl_base_send_workspace_changed(cl->resource, output.c_str(),
+                    ws.x, ws.y);
+            }
+        }
+    }
+
+    pending_events = 0;
+    pending_views.clear();
+    pending_workspaces.clear();
+}
@@ -0,0 +1,429 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2023 Scott Moreau
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <algorithm>
+#include <wayfire/core.hpp>
+#include <wayfire/view.hpp>
+#include <wayfire/output.hpp>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/workspace-manager.hpp>
+
+#include "wayfire-control.hpp"
+#include "wayfire-control-server-protocol.h"
+
+static int handle_wait_timeout(void *data)
+{
+    auto wait = (wayfire_control_wait*)data;
+    wait->ctrl->finish_wait(wait, WF_CTRL_BASE_STATUS_TIMEOUT);
+    return 0;
+}
+
+wayfire_control_wait::~wayfire_control_wait()
+{
+    if (timer)
+    {
+        wl_event_source_remove(timer);
+    }
+}
+
+/* Whether the condition of @wait holds, or the status to end it with */
+bool wayfire_control::wait_done(const wayfire_control_wait& wait, uint32_t& status)
+{
+    status = WF_CTRL_BASE_STATUS_OK;
+
+    if (wait.type == wayfire_control_wait::VIEW_MAPPED)
+    {
+        for (auto& [id, view] : views)
+        {
+            if (view->get_app_id() == wait.app_id)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    if (wait.type == wayfire_control_wait::FRAME)
+    {
+        return wait.frames > 0;
+    }
+
+    if (wait.type == wayfire_control_wait::COMMIT)
+    {
+        /* Views that went away have nothing more to commit */
+        for (auto& target : wait.targets)
+        {
+            auto it = views.find(target.view_id);
+            if (it == views.end())
+            {
+                continue;
+            }
+
+            auto geometry = it->second->get_wm_geometry();
+            if ((target.mask & target.POSITION) &&
+                ((geometry.x != target.geometry.x) || (geometry.y != target.geometry.y)))
+            {
+                return false;
+            }
+
+            /*
+             * Clients may clamp or round the size asked for, so any new
+             * size they commit answers the configure as well
+             */
+            if ((target.mask & target.SIZE) &&
+                ((geometry.width != target.geometry.width) ||
+                 (geometry.height != target.geometry.height)) &&
+                (geometry.width == target.start.width) &&
+                (geometry.height == target.start.height))
+            {
+                return false;
+            }
+
+            if ((target.mask & target.CHANGE) && (geometry == target.geometry))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    auto it = views.find(wait.view_id);
+    if (it == views.end())
+    {
+        status = WF_CTRL_BASE_STATUS_NO_VIEW;
+        return true;
+    }
+
+    if (wait.type == wayfire_control_wait::GEOMETRY)
+    {
+        return it->second->get_wm_geometry() == wait.geometry;
+    }
+
+    return !it->second->has_transformer();
+}
+
+void wayfire_control::add_wait(std::unique_ptr<wayfire_control_wait> wait,
+    uint32_t timeout)
+{
+    uint32_t status;
+    if (wait_done(*wait, status))
+    {
+        end_wait(*wait, status);
+        return;
+    }
+
+    wait->ctrl = this;
+    if ((wait->type == wayfire_control_wait::ANIMATION) && (timeout == 0))
+    {
+        timeout = wayfire_control_wait::ANIMATION_TIMEOUT;
+    }
+
+    /* A size the view keeps anyway is never committed again */
+    if ((wait->type == wayfire_control_wait::COMMIT) && (timeout == 0))
+    {
+        timeout = wayfire_control_wait::COMMIT_TIMEOUT;
+    }
+
+    if (timeout > 0)
+    {
+        wait->timer = wl_event_loop_add_timer(wf::get_core().ev_loop,
+            handle_wait_timeout, wait.get());
+        wl_event_source_timer_update(wait->timer, timeout);
+    }
+
+    if (wait->output)
+    {
+        hook_frames(wait->output);
+    }
+
+    waits.push_back(std::move(wait));
+}
+
+/* Answer @wait, with the geometries it ended up with first for COMMIT */
+void wayfire_control::end_wait(const wayfire_control_wait& wait, uint32_t status)
+{
+    auto cl = wait.reply.client.lock();
+    for (auto& target : wait.targets)
+    {
+        auto it = views.find(target.view_id);
+        if (cl && (it != views.end()))
+        {
+            auto geometry = it->second->get_wm_geometry();
+            wf_ctrl_base_send_committed_geometry(cl->resource, wait.reply.serial,
+                target.view_id, geometry.x, geometry.y, geometry.width, geometry.height);
+        }
+    }
+
+    wait.reply.send(status);
+}
+
+void wayfire_control::finish_wait(wayfire_control_wait *wait, uint32_t status)
+{
+    end_wait(*wait, status);
+    waits.remove_if([=] (auto& w) { return w.get() == wait; });
+}
+
+/* Answer the waits of @type whose condition now holds */
+void wayfire_control::check_waits(wayfire_control_wait::type_t type)
+{
+    for (auto it = waits.begin(); it != waits.end();)
+    {
+        uint32_t status;
+        if (((*it)->type == type) && wait_done(**it, status))
+        {
+            end_wait(**it, status);
+            it = waits.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+/*
+ * Add what @op, about to be applied, should make its view commit to a
+ * COMMIT wait. Operations on the same view add up to one target.
+ */
+void wayfire_control::add_commit_target(wayfire_control_wait& wait,
+    const wayfire_control_op& op)
+{
+    using target_t = wayfire_control_wait::target_t;
+
+    wayfire_view view = view_from_id(op.view_id);
+    if (!view)
+    {
+        return;
+    }
+
+    auto target = std::find_if(wait.targets.begin(), wait.targets.end(),
+        [=] (auto& t) { return t.view_id == view->get_id(); });
+    if (target == wait.targets.end())
+    {
+        auto geometry = view->get_wm_geometry();
+        wait.targets.push_back({view->get_id(), 0, geometry, geometry});
+        target = wait.targets.end() - 1;
+    }
+
+    switch (op.type)
+    {
+      case wayfire_control_op::MOVE:
+        target->mask |= target_t::POSITION;
+        target->geometry.x = op.x;
+        target->geometry.y = op.y;
+        break;
+
+      case wayfire_control_op::RESIZE:
+        target->mask |= target_t::SIZE;
+        target->geometry.width  = op.w;
+        target->geometry.height = op.h;
+        break;
+
+      case wayfire_control_op::SET_GEOMETRY:
+      {
+        wf::output_t *output;
+        if (target_geometry(op, view, output, target->geometry) ==
+            WF_CTRL_BASE_STATUS_OK)
+        {
+            target->mask |= target_t::POSITION | target_t::SIZE;
+        }
+
+        break;
+      }
+
+      case wayfire_control_op::TILE:
+        /* Where partly tiled views go is up to whoever tiles them */
+        if (op.edges != wf::TILED_EDGES_ALL)
+        {
+            break;
+        }
+
+      /* Fall through */
+      case wayfire_control_op::MAXIMIZE:
+        if (view->get_output())
+        {
+            target->mask    |= target_t::POSITION | target_t::SIZE;
+            target->geometry = view->get_output()->workspace->get_workarea();
+        }
+
+        break;
+
+      case wayfire_control_op::UNMAXIMIZE:
+        /* Where it goes back to is up to the view */
+        if (view->tiled_edges)
+        {
+            target->mask |= target_t::CHANGE;
+        }
+
+        break;
+
+      default:
+        break;
+    }
+
+    if (!target->mask)
+    {
+        wait.targets.erase(target);
+    }
+}
+
+/*
+ * Count a frame for the waits on @output after each frame it renders, as
+ * long as there are some waits or latency samples. The hook itself stays
+ * around for the output's lifetime, only its registration comes and goes.
+ * Without @redraw, it only watches for frames rendered anyway.
+ */
+void wayfire_control::hook_frames(wf::output_t *output, bool redraw)
+{
+    auto& hook = frame_hooks[output];
+    if (!hook.active)
+    {
+        hook.hook = [=] ()
+        {
+            handle_frame(output);
+        };
+        output->render->add_effect(&hook.hook, wf::OUTPUT_EFFECT_POST);
+        hook.active = true;
+    }
+
+    if (redraw)
+    {
+        output->render->schedule_redraw();
+    }
+}
+
+void wayfire_control::handle_frame(wf::output_t *output)
+{
+    for (auto& wait : waits)
+    {
+        if (wait->output == output)
+        {
+            wait->frames++;
+        }
+    }
+
+    check_waits(wayfire_control_wait::FRAME);
+    check_waits(wayfire_control_wait::ANIMATION);
+    sample_frame(output);
+
+    /*
+     * Animations end with one more frame, so keep them coming, on the
+     * output the view is on now. Views left without one never animate.
+     */
+    bool redraw = false;
+    for (auto it = waits.begin(); it != waits.end();)
+    {
+        auto& wait = **it;
+        if ((wait.type != wayfire_control_wait::ANIMATION) || (wait.output != output))
+        {
+            ++it;
+            continue;
+        }
+
+        auto view = views.find(wait.view_id);
+        auto view_output = (view != views.end()) ? view->second->get_output() : nullptr;
+        if (!view_output)
+        {
+            end_wait(wait, (view != views.end()) ?
+                WF_CTRL_BASE_STATUS_NO_OUTPUT : WF_CTRL_BASE_STATUS_NO_VIEW);
+            it = waits.erase(it);
+            continue;
+        }
+
+        if (view_output != output)
+        {
+            wait.output = view_output;
+            hook_frames(view_output);
+        }
+        else
+        {
+            redraw = true;
+        }
+
+        ++it;
+    }
+
+    if (redraw)
+    {
+        output->render->schedule_redraw();
+    }
+
+    for (auto& wait : waits)
+    {
+        if (wait->output == output)
+        {
+            return;
+        }
+    }
+
+    if (frame_samples.count(output))
+    {
+        return;
+    }
+
+    output->render->rem_effect(&frame_hooks[output].hook);
+    frame_hooks[output].active = false;
+}
+
+/* Waits on an output that goes away end with no_output */
+void wayfire_control::output_removed(wf::output_t *output)
+{
+    for (auto it = waits.begin(); it != waits.end();)
+    {
+        if ((*it)->output == output)
+        {
+            end_wait(**it, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+            it = waits.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    /* Their frame never comes, they are recorded once they expire */
+    for (auto& [id, sample] : open_samples)
+    {
+        if (sample.output == output)
+        {
+            sample.output = nullptr;
+        }
+    }
+
+    frame_samples.erase(output);
+
+    auto hook = frame_hooks.find(output);
+    if (hook != frame_hooks.end())
+    {
+        if (hook->second.active)
+        {
+            output->render->rem_effect(&hook->second.hook);
+        }
+
+        frame_hooks.erase(hook);
+    }
+}
@@ -24,6 +24,17 @@
 
 
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <cerrno>
+#include <unistd.h>
+#include <cmath>
+#include <ctime>
+#include <utility>
+#include <algorithm>
 #include <wayfire/core.hpp>
 #include <wayfire/view.hpp>
 #include <wayfire/plugin.hpp>
@@ -42,25 +53,37 @@ extern "C"
 #include <wlr/backend/multi.h>
 #include <wlr/backend/headless.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_touch.h>
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/interfaces/wlr_keyboard.h>
 #include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_touch.h>
 #include <wlr/types/wlr_virtual_pointer_v1.h>
 #include <wlr/types/wlr_virtual_keyboard_v1.h>
 #include <wlr/types/wlr_output_layout.h>
-#include <libevdev/libevdev.h>
 }
 
 #include "wayfire-control.hpp"
+#include "input-replay.hpp"
+#include "snapshot.hpp"
 #include "wayfire-control-server-protocol.h"
 
 static void bind_manager(wl_client *client, void *data,
     uint32_t version, uint32_t id);
+static int handle_release_timer(void *data);
+static int handle_typing_timer(void *data);
+static int handle_path_timer(void *data);
+static int handle_coalesce_timer(void *data);
+static int handle_queue_timer(void *data);
 
 static const struct wlr_pointer_impl pointer_impl = {
     .name = "wf-control-pointer",
 };
 
+static const struct wlr_touch_impl touch_impl = {
+    .name = "wf-control-touch",
+};
+
 static void led_update(wlr_keyboard *keyboard, uint32_t leds)
 {}
 
@@ -72,7 +95,7 @@ static const struct wlr_keyboard_impl keyboard_impl = {
 wayfire_control::wayfire_control()
 {
     manager = wl_global_create(wf::get_core().display,
-        &wf_ctrl_base_interface, 1, this, bind_manager);
+        &wf_ctrl_base_interface, 2, this, bind_manager);
 
     if (!manager)
     {
@@ -86,604 +109,2034 @@ wayfire_control::wayfire_control()
 
     wlr_pointer_init(&pointer, &pointer_impl, "wf_control_pointer");
     wlr_keyboard_init(&keyboard, &keyboard_impl, "wf_control_keyboard");
+    wlr_touch_init(&touch, &touch_impl, "wf_control_touch");
+    release_timer = wl_event_loop_add_timer(core.ev_loop, handle_release_timer, this);
+    typing_timer  = wl_event_loop_add_timer(core.ev_loop, handle_typing_timer, this);
+    path_timer    = wl_event_loop_add_timer(core.ev_loop, handle_path_timer, this);
+    coalesce_timer = wl_event_loop_add_timer(core.ev_loop, handle_coalesce_timer, this);
+    queue_timer    = wl_event_loop_add_timer(core.ev_loop, handle_queue_timer, this);
 
     if (core.get_current_state() == wf::compositor_state_t::RUNNING)
     {
         wlr_backend_start(backend);
     }
+
+    for (auto& view : core.get_all_views())
+    {
+        if (view->is_mapped())
+        {
+            views[view->get_id()] = view;
+        }
+    }
+
+    on_view_mapped.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        views[view->get_id()] = view;
+        view_mapped(view);
+    });
+    on_view_unmapped.set_callback([=] (wf::signal_data_t *data)
+    {
+        auto view = get_signaled_view(data);
+        views.erase(view->get_id());
+        for (auto& cl : clients)
+        {
+            auto& fixed = cl->fixed_views;
+            fixed.erase(std::remove(fixed.begin(), fixed.end(), view), fixed.end());
+        }
+
+        view_unmapped(view);
+    });
+    core.connect_signal("view-mapped", &on_view_mapped);
+    core.connect_signal("view-unmapped", &on_view_unmapped);
+    init_events();
 }
 
 wayfire_control::~wayfire_control()
 {
     auto& core = wf::get_core();
+    on_view_mapped.disconnect();
+    on_view_unmapped.disconnect();
+    fini_events();
+    wl_event_source_remove(release_timer);
+    wl_event_source_remove(typing_timer);
+    wl_event_source_remove(path_timer);
+    wl_event_source_remove(coalesce_timer);
+    wl_event_source_remove(queue_timer);
+    if (keysym_keymap)
+    {
+        xkb_keymap_unref(keysym_keymap);
+    }
     wlr_multi_backend_remove(core.backend, backend);
     wlr_backend_destroy(backend);
 
-    wl_global_destroy(manager);
+    wl_global_destroy(manager);
+}
+
+wayfire_view wayfire_control::view_from_id(int32_t id)
+{
+    if (id == -1)
+    {
+        auto output = wf::get_core().get_active_output();
+        return output ? output->get_active_view() : nullptr;
+    }
+
+    auto it = views.find(uint32_t(id));
+    if (it == views.end())
+    {
+        return nullptr;
+    }
+
+    return it->second;
+}
+
+void wayfire_control::key_event(uint32_t keycode, wl_keyboard_key_state state)
+{
+    wlr_keyboard_key_event ev;
+    ev.keycode = keycode;
+    ev.state   = state;
+    ev.update_state = true;
+    ev.time_msec    = wf::get_current_time();
+
+    wlr_keyboard_notify_key(&keyboard, &ev);
+}
+
+void wayfire_control::button_event(uint32_t button, wlr_button_state state)
+{
+    wlr_pointer_button_event ev;
+    ev.pointer   = &pointer;
+    ev.button    = button;
+    ev.state     = state;
+    ev.time_msec = wf::get_current_time();
+    wl_signal_emit(&pointer.events.button, &ev);
+    wl_signal_emit(&pointer.events.frame, NULL);
+}
+
+void wayfire_control::motion_event(double dx, double dy)
+{
+    wlr_pointer_motion_event ev;
+    ev.pointer   = &pointer;
+    ev.time_msec = wf::get_current_time();
+    ev.delta_x   = ev.unaccel_dx = dx;
+    ev.delta_y   = ev.unaccel_dy = dy;
+    wl_signal_emit(&pointer.events.motion, &ev);
+    wl_signal_emit(&pointer.events.frame, NULL);
+}
+
+/*
+ * Our devices are not mapped to an output, so the core maps their absolute
+ * coordinates onto the box around the whole layout. Returns false if there
+ * is no layout to map layout coordinates @x, @y onto.
+ */
+static bool layout_to_absolute(double& x, double& y)
+{
+    wlr_box box;
+    wlr_output_layout_get_box(wf::get_core().output_layout->get_handle(), NULL, &box);
+    if ((box.width <= 0) || (box.height <= 0))
+    {
+        return false;
+    }
+
+    x = (x - box.x) / box.width;
+    y = (y - box.y) / box.height;
+    return true;
+}
+
+/* Move the pointer to layout coordinates, false if there is no layout */
+bool wayfire_control::motion_absolute_event(double x, double y)
+{
+    if (!layout_to_absolute(x, y))
+    {
+        return false;
+    }
+
+    wlr_pointer_motion_absolute_event ev;
+    ev.pointer   = &pointer;
+    ev.time_msec = wf::get_current_time();
+    ev.x = x;
+    ev.y = y;
+    wl_signal_emit(&pointer.events.motion_absolute, &ev);
+    wl_signal_emit(&pointer.events.frame, NULL);
+    return true;
+}
+
+/* Touch points are in layout coordinates too */
+bool wayfire_control::touch_down_event(int32_t id, double x, double y)
+{
+    if (!layout_to_absolute(x, y))
+    {
+        return false;
+    }
+
+    wlr_touch_down_event ev;
+    ev.touch     = &touch;
+    ev.time_msec = wf::get_current_time();
+    ev.touch_id  = id;
+    ev.x = x;
+    ev.y = y;
+    wl_signal_emit(&touch.events.down, &ev);
+    wl_signal_emit(&touch.events.frame, NULL);
+    return true;
+}
+
+bool wayfire_control::touch_motion_event(int32_t id, double x, double y)
+{
+    if (!layout_to_absolute(x, y))
+    {
+        return false;
+    }
+
+    wlr_touch_motion_event ev;
+    ev.touch     = &touch;
+    ev.time_msec = wf::get_current_time();
+    ev.touch_id  = id;
+    ev.x = x;
+    ev.y = y;
+    wl_signal_emit(&touch.events.motion, &ev);
+    wl_signal_emit(&touch.events.frame, NULL);
+    return true;
+}
+
+void wayfire_control::touch_up_event(int32_t id)
+{
+    wlr_touch_up_event ev;
+    ev.touch     = &touch;
+    ev.time_msec = wf::get_current_time();
+    ev.touch_id  = id;
+    wl_signal_emit(&touch.events.up, &ev);
+    wl_signal_emit(&touch.events.frame, NULL);
+}
+
+void wayfire_control::axis_event(wlr_axis_orientation orientation, double delta,
+    int32_t discrete)
+{
+    wlr_pointer_axis_event ev;
+    ev.pointer     = &pointer;
+    ev.time_msec   = wf::get_current_time();
+    ev.source      = discrete ? WLR_AXIS_SOURCE_WHEEL : WLR_AXIS_SOURCE_CONTINUOUS;
+    ev.orientation = orientation;
+    ev.delta       = delta;
+    ev.delta_discrete = discrete;
+    wl_signal_emit(&pointer.events.axis, &ev);
+    wl_signal_emit(&pointer.events.frame, NULL);
+}
+
+void wayfire_control::stroke_event(bool button, uint32_t code, bool pressed)
+{
+    if (button)
+    {
+        button_event(code, pressed ? WLR_BUTTON_PRESSED : WLR_BUTTON_RELEASED);
+    }
+    else
+    {
+        key_event(code, pressed ? WL_KEYBOARD_KEY_STATE_PRESSED :
+            WL_KEYBOARD_KEY_STATE_RELEASED);
+    }
+}
+
+int64_t wayfire_control::frame_interval_us()
+{
+    int64_t interval = 0;
+    for (auto output : wf::get_core().output_layout->get_outputs())
+    {
+        /* The refresh rate is in mHz */
+        if (output->handle->refresh > 0)
+        {
+            int64_t us = 1000000000 / output->handle->refresh;
+            interval = interval ? std::min(interval, us) : us;
+        }
+    }
+
+    return interval ? std::max<int64_t>(interval, 1000) : 16000;
+}
+
+int private_nonblocking_fd(int fd)
+{
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || S_ISREG(st.st_mode) || S_ISSOCK(st.st_mode))
+    {
+        return fd;
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    std::string path = "/proc/self/fd/" + std::to_string(fd);
+    int private_fd   = open(path.c_str(), (flags & (O_ACCMODE | O_APPEND)) |
+        O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+    ::close(fd);
+    return private_fd;
+}
+
+ssize_t read_nonblocking(int fd, void *data, size_t size)
+{
+    ssize_t len = recv(fd, data, size, MSG_DONTWAIT);
+    if ((len >= 0) || (errno != ENOTSOCK))
+    {
+        return len;
+    }
+
+    return read(fd, data, size);
+}
+
+ssize_t write_nosigpipe(int fd, const void *data, size_t size)
+{
+    ssize_t len = send(fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if ((len >= 0) || (errno != ENOTSOCK))
+    {
+        return len;
+    }
+
+    /*
+     * Pipes have no such flag. Block SIGPIPE around the write and take back
+     * the one it raised, unless one was already pending for someone else.
+     */
+    sigset_t pipe_set, old_set, pending;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+    sigpending(&pending);
+    bool was_pending = sigismember(&pending, SIGPIPE);
+
+    len = write(fd, data, size);
+    int error = errno;
+    if ((len < 0) && (error == EPIPE) && !was_pending)
+    {
+        struct timespec zero = {0, 0};
+        while ((sigtimedwait(&pipe_set, nullptr, &zero) < 0) && (errno == EINTR))
+        {}
+    }
+
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    errno = error;
+    return len;
+}
+
+int64_t monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t release_key(bool button, uint32_t code)
+{
+    return (button ? 1u << 16 : 0) | code;
+}
+
+/* Orders the release heap so the earliest release is at the front */
+static bool release_later(const wayfire_control::release_t& a,
+    const wayfire_control::release_t& b)
+{
+    return a.time > b.time || (a.time == b.time && a.seq > b.seq);
+}
+
+static int handle_release_timer(void *data)
+{
+    ((wayfire_control*)data)->dispatch_releases();
+    return 0;
+}
+
+static int handle_typing_timer(void *data)
+{
+    ((wayfire_control*)data)->run_typing();
+    return 0;
+}
+
+static int handle_path_timer(void *data)
+{
+    ((wayfire_control*)data)->run_paths();
+    return 0;
+}
+
+void wayfire_control::arm_release_timer()
+{
+    if (releases.empty())
+    {
+        return;
+    }
+
+    /* A zero timeout would disarm the timer instead of firing it */
+    int64_t delay = releases.front().time - monotonic_us() / 1000;
+    wl_event_source_timer_update(release_timer, std::max<int64_t>(delay, 1));
+}
+
+bool wayfire_control::cancel_release(bool button, uint32_t code)
+{
+    /* The heap entry stays behind and is skipped once it comes up */
+    return pending_releases.erase(release_key(button, code)) > 0;
+}
+
+void wayfire_control::stroke(bool button, uint32_t code, int delay)
+{
+    /* Striking a key again before its release is due releases it first */
+    if (cancel_release(button, code))
+    {
+        stroke_event(button, code, false);
+    }
+
+    stroke_event(button, code, true);
+
+    release_t release;
+    release.time   = monotonic_us() / 1000 + std::max(delay, 0);
+    release.seq    = ++release_seq;
+    release.button = button;
+    release.code   = code;
+    releases.push_back(release);
+    std::push_heap(releases.begin(), releases.end(), release_later);
+    pending_releases[release_key(button, code)] = release.seq;
+
+    arm_release_timer();
+}
+
+void wayfire_control::dispatch_releases()
+{
+    int64_t now = monotonic_us() / 1000;
+
+    while (!releases.empty() && (releases.front().time <= now))
+    {
+        std::pop_heap(releases.begin(), releases.end(), release_later);
+        release_t release = releases.back();
+        releases.pop_back();
+
+        auto it = pending_releases.find(release_key(release.button, release.code));
+        if ((it == pending_releases.end()) || (it->second != release.seq))
+        {
+            continue;
+        }
+
+        pending_releases.erase(it);
+        stroke_event(release.button, release.code, false);
+    }
+
+    arm_release_timer();
+}
+
+static void flush_coalesced(wayfire_control_client *cl);
+
+/*
+ * Requests that coalescing mode cannot hold back first apply what it
+ * holds back, so that replies keep coming in request order.
+ */
+static wayfire_control_client *request_begin(wl_resource *resource,
+    bool coalescable = false)
+{
+    auto cl = (wayfire_control_client*)wl_resource_get_user_data(resource);
+    if (!coalescable && !cl->coalesced.empty())
+    {
+        flush_coalesced(cl);
+    }
+
+    cl->serial++;
+    return cl;
+}
+
+/* Reply to the request currently being handled, to its client only */
+static void send_done(wl_resource *resource, uint32_t serial, uint32_t status)
+{
+    if (wl_resource_get_version(resource) >= WF_CTRL_BASE_DONE_SINCE_VERSION)
+    {
+        wf_ctrl_base_send_done(resource, serial, status);
+    }
+    else
+    {
+        wf_ctrl_base_send_ack(resource);
+    }
+}
+
+static void send_done(wayfire_control_client *cl, uint32_t status)
+{
+    send_done(cl->resource, cl->serial, status);
+    cl->ctrl->end_sample(cl->sample);
+}
+
+wayfire_control_reply wayfire_control_client::defer_reply()
+{
+    return {weak_from_this(), serial, sample};
+}
+
+void wayfire_control_reply::send(uint32_t status) const
+{
+    if (auto cl = client.lock())
+    {
+        send_done(cl->resource, serial, status);
+        cl->ctrl->end_sample(sample);
+    }
+}
+
+uint32_t wayfire_control::apply(const wayfire_control_op& op)
+{
+    wayfire_view view = view_from_id(op.view_id);
+
+    if (!view)
+    {
+        return WF_CTRL_BASE_STATUS_NO_VIEW;
+    }
+
+    switch (op.type)
+    {
+      case wayfire_control_op::MAXIMIZE:
+        view->tile_request(wf::TILED_EDGES_ALL);
+        break;
+
+      case wayfire_control_op::UNMAXIMIZE:
+        view->tile_request(0);
+        break;
+
+      case wayfire_control_op::MINIMIZE:
+        view->minimize_request(true);
+        break;
+
+      case wayfire_control_op::UNMINIMIZE:
+        view->minimize_request(false);
+        break;
+
+      case wayfire_control_op::MOVE:
+        view->move(op.x, op.y);
+        break;
+
+      case wayfire_control_op::RESIZE:
+        view->resize(op.w, op.h);
+        break;
+
+      case wayfire_control_op::SET_GEOMETRY:
+      {
+        wf::output_t *output;
+        wf::geometry_t geometry;
+        uint32_t status = target_geometry(op, view, output, geometry);
+        if (status != WF_CTRL_BASE_STATUS_OK)
+        {
+            return status;
+        }
+
+        if (output != view->get_output())
+        {
+            wf::get_core().move_view_to_output(view, output, false);
+        }
+
+        /* Position and size go to the client in a single configure */
+        view->set_geometry(geometry);
+        break;
+      }
+
+      case wayfire_control_op::TILE:
+        view->tile_request(op.edges);
+        break;
+    }
+
+    return WF_CTRL_BASE_STATUS_OK;
+}
+
+/*
+ * Where a SET_GEOMETRY @op puts @view: the output, and the geometry
+ * relative to that output's current workspace. A size of 0 keeps the
+ * view's own.
+ */
+uint32_t wayfire_control::target_geometry(const wayfire_control_op& op,
+    wayfire_view view, wf::output_t*& output, wf::geometry_t& geometry)
+{
+    output = op.output.empty() ? view->get_output() :
+        wf::get_core().output_layout->find_output(op.output);
+    if (!output)
+    {
+        return WF_CTRL_BASE_STATUS_NO_OUTPUT;
+    }
+
+    auto current = view->get_wm_geometry();
+    geometry = {op.x, op.y, op.w ? op.w : current.width, op.h ? op.h : current.height};
+    if ((geometry.width <= 0) || (geometry.height <= 0))
+    {
+        return WF_CTRL_BASE_STATUS_INVALID_ARGUMENT;
+    }
+
+    if ((op.workspace.x < 0) || (op.workspace.y < 0))
+    {
+        return WF_CTRL_BASE_STATUS_OK;
+    }
+
+    auto grid = output->workspace->get_workspace_grid_size();
+    if ((op.workspace.x >= grid.width) || (op.workspace.y >= grid.height))
+    {
+        return WF_CTRL_BASE_STATUS_INVALID_ARGUMENT;
+    }
+
+    auto ws   = output->workspace->get_current_workspace();
+    auto size = output->get_screen_size();
+    geometry.x += (op.workspace.x - ws.x) * size.width;
+    geometry.y += (op.workspace.y - ws.y) * size.height;
+    return WF_CTRL_BASE_STATUS_OK;
+}
+
+bool wayfire_control_selector::matches(wayfire_view view) const
+{
+    if (!app_id.empty() && (view->get_app_id() != app_id))
+    {
+        return false;
+    }
+
+    if (title && !std::regex_search(view->get_title(), *title))
+    {
+        return false;
+    }
+
+    auto view_output = view->get_output();
+    if (!output.empty() && (!view_output || (output != view_output->handle->name)))
+    {
+        return false;
+    }
+
+    if (any_workspace)
+    {
+        return true;
+    }
+
+    return view_output &&
+           (view_output->workspace->get_view_main_workspace(view) == workspace);
+}
+
+/* The views @view_id stands for, in order of ID for the selected views */
+std::vector<wayfire_view> wayfire_control_client::select(int32_t view_id)
+{
+    std::vector<wayfire_view> result;
+
+    if (view_id != SELECTED_VIEWS_ID)
+    {
+        if (auto view = ctrl->view_from_id(view_id))
+        {
+            result.push_back(view);
+        }
+
+        return result;
+    }
+
+    if (!selector)
+    {
+        return result;
+    }
+
+    for (auto& [id, view] : ctrl->views)
+    {
+        if (selector->matches(view))
+        {
+            result.push_back(view);
+        }
+    }
+
+    std::sort(result.begin(), result.end(), [] (wayfire_view a, wayfire_view b)
+    {
+        return a->get_id() < b->get_id();
+    });
+    return result;
+}
+
+/*
+ * Apply @ops and answer with @reply, with @status unless it is ok, else
+ * the status of the first that failed. In commit ack mode, the answer
+ * waits until the views have committed the geometry the operations ask
+ * for.
+ */
+static void apply_ops(wayfire_control_client *cl, const std::vector<wayfire_control_op>& ops,
+    const wayfire_control_reply& reply, uint32_t status = WF_CTRL_BASE_STATUS_OK)
+{
+    wayfire_control *wd = cl->ctrl;
+
+    std::unique_ptr<wayfire_control_wait> wait;
+    if (cl->ack_mode == WF_CTRL_BASE_ACK_MODE_COMMIT)
+    {
+        wait = std::make_unique<wayfire_control_wait>();
+        wait->type = wayfire_control_wait::COMMIT;
+    }
+
+    /* The views expected to commit a new geometry */
+    std::vector<wayfire_view> views;
+    for (auto& op : ops)
+    {
+        auto view = wd->view_from_id(op.view_id);
+        if (view && (op.type != wayfire_control_op::MINIMIZE) &&
+            (op.type != wayfire_control_op::UNMINIMIZE))
+        {
+            views.push_back(view);
+        }
+    }
+
+    wd->sample_views(reply.sample, views);
+
+    for (auto& op : ops)
+    {
+        if (wait)
+        {
+            wd->add_commit_target(*wait, op);
+        }
+
+        uint32_t op_status = wd->apply(op);
+        if (status == WF_CTRL_BASE_STATUS_OK)
+        {
+            status = op_status;
+        }
+    }
+
+    if (!wait || (status != WF_CTRL_BASE_STATUS_OK))
+    {
+        reply.send(status);
+        return;
+    }
+
+    wait->reply = reply;
+    wd->add_wait(std::move(wait), cl->ack_timeout);
+}
+
+static void apply_ops(wayfire_control_client *cl, const std::vector<wayfire_control_op>& ops)
+{
+    apply_ops(cl, ops, cl->defer_reply());
+}
+
+/* Hold back @entry until the next frame, superseding the same kind of change */
+void wayfire_control_client::add_coalesced(coalesced_t entry)
+{
+    for (auto& other : coalesced)
+    {
+        if ((other.motion == entry.motion) &&
+            (entry.motion ||
+             ((other.op.type == entry.op.type) && (other.op.view_id == entry.op.view_id))))
+        {
+            other.merged = true;
+        }
+    }
+
+    coalesced.push_back(std::move(entry));
+    if (!ctrl->coalesce_pending)
+    {
+        wl_event_source_timer_update(ctrl->coalesce_timer,
+            wayfire_control::frame_interval_us() / 1000);
+        ctrl->coalesce_pending = true;
+    }
+}
+
+/* Apply what is held back, and answer what was superseded with merged */
+static void flush_coalesced(wayfire_control_client *cl)
+{
+    auto entries = std::move(cl->coalesced);
+    cl->coalesced.clear();
+
+    for (auto& entry : entries)
+    {
+        if (entry.merged)
+        {
+            entry.reply.send(WF_CTRL_BASE_STATUS_MERGED);
+        }
+        else if (entry.motion)
+        {
+            entry.reply.send(cl->ctrl->motion_absolute_event(entry.op.x, entry.op.y) ?
+                WF_CTRL_BASE_STATUS_OK : WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        }
+        else
+        {
+            apply_ops(cl, {entry.op}, entry.reply);
+        }
+    }
+}
+
+static int handle_coalesce_timer(void *data)
+{
+    auto wd = (wayfire_control*)data;
+    wd->coalesce_pending = false;
+    for (auto& cl : wd->clients)
+    {
+        flush_coalesced(cl.get());
+    }
+
+    return 0;
+}
+
+/*
+ * Apply @op to each view it selects now, or hold it back until commit if
+ * a transaction is open.
+ */
+static void queue_or_apply(wayfire_control_client *cl, wayfire_control_op op)
+{
+    auto views = cl->select(op.view_id);
+    if (views.empty())
+    {
+        /* Fails with no_view when applied */
+        views.push_back(nullptr);
+    }
+
+    std::vector<wayfire_control_op> ops;
+    for (auto view : views)
+    {
+        if (view)
+        {
+            op.view_id = view->get_id();
+        }
+
+        ops.push_back(op);
+    }
+
+    if (cl->in_transaction)
+    {
+        cl->transaction.insert(cl->transaction.end(), ops.begin(), ops.end());
+        return;
+    }
+
+    /* Only geometry changes of a single view are coalesced */
+    if (cl->coalesce && (ops.size() == 1) &&
+        ((op.type == wayfire_control_op::MOVE) || (op.type == wayfire_control_op::RESIZE) ||
+         (op.type == wayfire_control_op::SET_GEOMETRY)))
+    {
+        cl->add_coalesced({ops[0], false, false, cl->defer_reply()});
+        return;
+    }
+
+    /* What is held back goes first, to keep replies in request order */
+    if (!cl->coalesced.empty())
+    {
+        flush_coalesced(cl);
+    }
+
+    apply_ops(cl, ops);
+}
+
+static void maximize(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    wayfire_control_op op{wayfire_control_op::MAXIMIZE, view_id};
+    queue_or_apply(cl, op);
+}
+
+static void unmaximize(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    wayfire_control_op op{wayfire_control_op::UNMAXIMIZE, view_id};
+    queue_or_apply(cl, op);
+}
+
+static void minimize(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    wayfire_control_op op{wayfire_control_op::MINIMIZE, view_id};
+    queue_or_apply(cl, op);
+}
+
+static void unminimize(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    wayfire_control_op op{wayfire_control_op::UNMINIMIZE, view_id};
+    queue_or_apply(cl, op);
+}
+
+static void focus(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    auto views = cl->select(view_id);
+
+    if (views.empty())
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_VIEW);
+        return;
+    }
+
+    /* With several views, the last one ends up focused */
+    uint32_t status = WF_CTRL_BASE_STATUS_OK;
+    for (auto view : views)
+    {
+        auto output = view->get_output();
+
+        if (!output)
+        {
+            status = WF_CTRL_BASE_STATUS_NO_OUTPUT;
+            continue;
+        }
+
+        wf::get_core().focus_output(output);
+        output->focus_view(view, true);
+        output->workspace->request_workspace(
+            output->workspace->get_view_main_workspace(view));
+    }
+
+    send_done(cl, status);
+}
+
+static void close(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    auto views = cl->select(view_id);
+
+    if (views.empty())
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_VIEW);
+        return;
+    }
+
+    for (auto view : views)
+    {
+        view->close();
+    }
+
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void move(struct wl_client *client, struct wl_resource *resource, int view_id, int x, int y)
+{
+    auto cl = request_begin(resource, true);
+
+    wayfire_control_op op{wayfire_control_op::MOVE, view_id};
+    op.x = x;
+    op.y = y;
+    queue_or_apply(cl, op);
+}
+
+static void resize(struct wl_client *client, struct wl_resource *resource, int view_id, int w, int h)
+{
+    auto cl = request_begin(resource, true);
+
+    wayfire_control_op op{wayfire_control_op::RESIZE, view_id};
+    op.w = w;
+    op.h = h;
+    queue_or_apply(cl, op);
+}
+
+static void set_geometry(struct wl_client *client, struct wl_resource *resource,
+    int view_id, int x, int y, int w, int h, const char *output, int ws_x, int ws_y)
+{
+    auto cl = request_begin(resource, true);
+
+    wayfire_control_op op{wayfire_control_op::SET_GEOMETRY, view_id};
+    op.x = x;
+    op.y = y;
+    op.w = w;
+    op.h = h;
+    op.output    = output;
+    op.workspace = {ws_x, ws_y};
+    queue_or_apply(cl, op);
+}
+
+static void layout(struct wl_client *client, struct wl_resource *resource,
+    uint32_t kind, struct wl_array *view_ids, const char *output_name, int gap)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    /* Queued like the operations it stands for, failures included */
+    auto fail = [=] (uint32_t status)
+    {
+        if (!cl->in_transaction)
+        {
+            send_done(cl, status);
+        }
+        else if (cl->transaction_status == WF_CTRL_BASE_STATUS_OK)
+        {
+            cl->transaction_status = status;
+        }
+    };
+
+    if (view_ids->size % sizeof(int32_t))
+    {
+        fail(WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    std::vector<wayfire_view> views;
+    int32_t *view_id;
+    wl_array_for_each(view_id, view_ids)
+    {
+        for (auto view : cl->select(*view_id))
+        {
+            if (std::find(views.begin(), views.end(), view) == views.end())
+            {
+                views.push_back(view);
+            }
+        }
+    }
+
+    if (views.empty())
+    {
+        fail(WF_CTRL_BASE_STATUS_NO_VIEW);
+        return;
+    }
+
+    auto output = *output_name ?
+        wf::get_core().output_layout->find_output(output_name) : views[0]->get_output();
+    if (!output)
+    {
+        fail(WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
+    }
+
+    auto geometries = wayfire_control_layout(kind,
+        output->workspace->get_workarea(), views.size(), std::max(gap, 0));
+    if (geometries.empty())
+    {
+        fail(WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    std::vector<wayfire_control_op> ops;
+    for (size_t i = 0; i < views.size(); i++)
+    {
+        wayfire_control_op op{wayfire_control_op::SET_GEOMETRY, (int32_t)views[i]->get_id()};
+        op.x = geometries[i].x;
+        op.y = geometries[i].y;
+        op.w = geometries[i].width;
+        op.h = geometries[i].height;
+        op.output = output->handle->name;
+        ops.push_back(op);
+    }
+
+    if (cl->in_transaction)
+    {
+        cl->transaction.insert(cl->transaction.end(), ops.begin(), ops.end());
+        return;
+    }
+
+    apply_ops(cl, ops);
+}
+
+static void save_layout(struct wl_client *client, struct wl_resource *resource, int32_t fd)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    if (cl->snapshot && cl->snapshot->is_active())
+    {
+        ::close(fd);
+        send_done(cl, WF_CTRL_BASE_STATUS_BUSY);
+        return;
+    }
+
+    fd = private_nonblocking_fd(fd);
+    if (fd < 0)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    /* Answered once the snapshot has been written out */
+    cl->snapshot = std::make_unique<wayfire_control_snapshot>(fd, wd->save_layout(),
+        cl->defer_reply());
+}
+
+static void restore_layout(struct wl_client *client, struct wl_resource *resource, int32_t fd)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    if (cl->snapshot && cl->snapshot->is_active())
+    {
+        ::close(fd);
+        send_done(cl, WF_CTRL_BASE_STATUS_BUSY);
+        return;
+    }
+
+    fd = private_nonblocking_fd(fd);
+    if (fd < 0)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    /* Everything is applied at once, in the dispatch the snapshot ends in */
+    auto reply = cl->defer_reply();
+    cl->snapshot = std::make_unique<wayfire_control_snapshot>(fd, reply,
+        [=] (const std::string& data)
+    {
+        std::vector<wayfire_control_op> ops;
+        uint32_t status = wd->restore_layout(data, ops);
+        if (status != WF_CTRL_BASE_STATUS_OK)
+        {
+            reply.send(status);
+            return;
+        }
+
+        apply_ops(cl, ops, reply);
+    });
+}
+
+static void ws_switch_view_append(struct wl_client *client, struct wl_resource *resource, int view_id)
+{
+    auto cl = request_begin(resource);
+
+    auto views = cl->select(view_id);
+
+    /* Version 1 clients expect no ack for this request */
+    bool reply = wl_resource_get_version(resource) >= WF_CTRL_BASE_DONE_SINCE_VERSION;
+
+    if (views.empty())
+    {
+        if (reply)
+        {
+            send_done(cl, WF_CTRL_BASE_STATUS_NO_VIEW);
+        }
+        return;
+    }
+
+    cl->fixed_views.insert(cl->fixed_views.end(), views.begin(), views.end());
+    if (reply)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_OK);
+    }
+}
+
+/* Outputs named by @name: the active one if empty, every one for "all" */
+static std::vector<wf::output_t*> outputs_from_name(const char *name)
+{
+    auto& core = wf::get_core();
+
+    if (!strcmp(name, "all"))
+    {
+        return core.output_layout->get_outputs();
+    }
+
+    auto output = *name ? core.output_layout->find_output(name) : core.get_active_output();
+    if (!output)
+    {
+        return {};
+    }
+
+    return {output};
+}
+
+static bool direction_delta(const char *direction, wf::point_t& delta)
+{
+    static const struct
+    {
+        const char *name;
+        wf::point_t delta;
+    } directions[] = {
+        {"up", {0, -1}},
+        {"down", {0, 1}},
+        {"left", {-1, 0}},
+        {"right", {1, 0}},
+    };
+
+    for (auto& d : directions)
+    {
+        if (!strcmp(direction, d.name))
+        {
+            delta = d.delta;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Switch the workspace of each output, taking along the fixed views that
+ * are on it. All outputs switch within this one dispatch, so they show
+ * their new workspace in the same frame.
+ */
+static void switch_workspaces(wayfire_control_client *cl,
+    const std::vector<wf::output_t*>& outputs, bool relative, wf::point_t ws)
+{
+    for (auto output : outputs)
+    {
+        wf::point_t target = ws;
+        if (relative)
+        {
+            auto current = output->workspace->get_current_workspace();
+            target = {current.x + ws.x, current.y + ws.y};
+        }
+
+        std::vector<wayfire_view> fixed_views;
+        for (auto& view : cl->fixed_views)
+        {
+            if (view->get_output() == output)
+            {
+                fixed_views.push_back(view);
+            }
+        }
+
+        output->workspace->request_workspace(target, fixed_views);
+    }
+
+    cl->fixed_views.clear();
+}
+
+static void ws_switch_output(struct wl_client *client, struct wl_resource *resource,
+    const char *output_name, const char *direction)
+{
+    auto cl = request_begin(resource);
+
+    wf::point_t delta;
+    if (!direction_delta(direction, delta))
+    {
+        cl->fixed_views.clear();
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    auto outputs = outputs_from_name(output_name);
+    if (outputs.empty())
+    {
+        cl->fixed_views.clear();
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
+    }
+
+    switch_workspaces(cl, outputs, true, delta);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void ws_switch_abs_output(struct wl_client *client, struct wl_resource *resource,
+    const char *output_name, int x, int y)
+{
+    auto cl = request_begin(resource);
+
+    auto outputs = outputs_from_name(output_name);
+    if (outputs.empty())
+    {
+        cl->fixed_views.clear();
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
+    }
+
+    switch_workspaces(cl, outputs, false, {x, y});
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void ws_switch(struct wl_client *client, struct wl_resource *resource, const char *direction)
+{
+    ws_switch_output(client, resource, "", direction);
+}
+
+static void ws_switch_abs(struct wl_client *client, struct wl_resource *resource, int x, int y)
+{
+    ws_switch_abs_output(client, resource, "", x, y);
+}
+
+static void do_keystroke(wayfire_control_client *cl, int keycode, int delay)
+{
+    if (keycode == -1)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    cl->ctrl->stroke(false, keycode, delay);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void do_keydown(wayfire_control_client *cl, int keycode)
+{
+    if (keycode == -1)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    cl->ctrl->key_event(keycode, WL_KEYBOARD_KEY_STATE_PRESSED);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void do_keyup(wayfire_control_client *cl, int keycode)
+{
+    if (keycode == -1)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    cl->ctrl->cancel_release(false, keycode);
+    cl->ctrl->key_event(keycode, WL_KEYBOARD_KEY_STATE_RELEASED);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void do_buttonstroke(wayfire_control_client *cl, int buttoncode, int delay)
+{
+    if (buttoncode == -1)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    cl->ctrl->stroke(true, buttoncode, delay);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void do_buttondown(wayfire_control_client *cl, int buttoncode)
+{
+    if (buttoncode == -1)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    cl->ctrl->button_event(buttoncode, WLR_BUTTON_PRESSED);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+static void do_buttonup(wayfire_control_client *cl, int buttoncode)
+{
+    if (buttoncode == -1)
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
+
+    cl->ctrl->cancel_release(true, buttoncode);
+    cl->ctrl->button_event(buttoncode, WLR_BUTTON_RELEASED);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+/* Key and button codes given by number, -1 if out of range */
+static int checked_code(uint32_t code)
+{
+    return code <= KEY_MAX ? int(code) : -1;
+}
+
+static void keystroke(struct wl_client *client, struct wl_resource *resource, const char *key, int delay)
+{
+    auto cl = request_begin(resource);
+    do_keystroke(cl, cl->ctrl->event_names.key_from_name(key), delay);
+}
+
+static void keydown(struct wl_client *client, struct wl_resource *resource, const char *key)
+{
+    auto cl = request_begin(resource);
+    do_keydown(cl, cl->ctrl->event_names.key_from_name(key));
+}
+
+static void keyup(struct wl_client *client, struct wl_resource *resource, const char *key)
+{
+    auto cl = request_begin(resource);
+    do_keyup(cl, cl->ctrl->event_names.key_from_name(key));
+}
+
+static void buttonstroke(struct wl_client *client, struct wl_resource *resource, const char *button, int delay)
+{
+    auto cl = request_begin(resource);
+    do_buttonstroke(cl, cl->ctrl->event_names.button_from_name(button), delay);
+}
+
+static void buttondown(struct wl_client *client, struct wl_resource *resource, const char *button)
+{
+    auto cl = request_begin(resource);
+    do_buttondown(cl, cl->ctrl->event_names.button_from_name(button));
+}
+
+static void buttonup(struct wl_client *client, struct wl_resource *resource, const char *button)
+{
+    auto cl = request_begin(resource);
+    do_buttonup(cl, cl->ctrl->event_names.button_from_name(button));
+}
+
+static void keystroke_code(struct wl_client *client, struct wl_resource *resource, uint32_t key, int delay)
+{
+    auto cl = request_begin(resource);
+    do_keystroke(cl, checked_code(key), delay);
+}
+
+static void keydown_code(struct wl_client *client, struct wl_resource *resource, uint32_t key)
+{
+    auto cl = request_begin(resource);
+    do_keydown(cl, checked_code(key));
+}
+
+static void keyup_code(struct wl_client *client, struct wl_resource *resource, uint32_t key)
+{
+    auto cl = request_begin(resource);
+    do_keyup(cl, checked_code(key));
+}
+
+static void buttonstroke_code(struct wl_client *client, struct wl_resource *resource, uint32_t button, int delay)
+{
+    auto cl = request_begin(resource);
+    do_buttonstroke(cl, checked_code(button), delay);
+}
+
+static void buttondown_code(struct wl_client *client, struct wl_resource *resource, uint32_t button)
+{
+    auto cl = request_begin(resource);
+    do_buttondown(cl, checked_code(button));
+}
+
+static void buttonup_code(struct wl_client *client, struct wl_resource *resource, uint32_t button)
+{
+    auto cl = request_begin(resource);
+    do_buttonup(cl, checked_code(button));
+}
+
+static void mousemove(struct wl_client *client, struct wl_resource *resource, int x, int y)
+{
+    auto cl = request_begin(resource, true);
+    wayfire_control *wd = cl->ctrl;
+
+    if (cl->coalesce)
+    {
+        wayfire_control_op op{wayfire_control_op::MOVE, 0};
+        op.x = x;
+        op.y = y;
+        cl->add_coalesced({op, true, false, cl->defer_reply()});
+        return;
+    }
+
+    if (!wd->motion_absolute_event(x, y))
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
+    }
+
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-wayfire_view view_from_id(int32_t id)
+static void axis(struct wl_client *client, struct wl_resource *resource,
+    uint32_t orientation, wl_fixed_t delta, int discrete)
 {
-    if (id == -1)
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    if (orientation > WF_CTRL_BASE_AXIS_ORIENTATION_HORIZONTAL)
     {
-        return wf::get_core().get_active_output()->get_active_view();
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
     }
 
-    for (auto& view : wf::get_core().get_all_views())
+    double value = wl_fixed_to_double(delta);
+    if (discrete && (value == 0))
     {
-        if (int32_t(view->get_id()) == id)
-        {
-            return view;
-        }
+        /* What libinput reports for one click of a wheel */
+        value = discrete * 15.0;
     }
 
-    return nullptr;
+    /* Discrete steps are in fractions of 120 of a wheel click */
+    wd->axis_event(orientation == WF_CTRL_BASE_AXIS_ORIENTATION_VERTICAL ?
+        WLR_AXIS_ORIENTATION_VERTICAL : WLR_AXIS_ORIENTATION_HORIZONTAL,
+        value, discrete * 120);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void maximize(struct wl_client *client, struct wl_resource *resource, int view_id)
+static void touch_down(struct wl_client *client, struct wl_resource *resource,
+    int id, int x, int y)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
-    wayfire_view view = view_from_id(view_id);
-
-    if (!view)
+    if (wd->touch_points.count(id))
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
         return;
     }
 
-    view->tile_request(wf::TILED_EDGES_ALL);
-    for (auto r : wd->client_resources)
+    if (!wd->touch_down_event(id, x, y))
     {
-        wf_ctrl_base_send_ack(r);
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
     }
+
+    wd->touch_points.insert(id);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void unmaximize(struct wl_client *client, struct wl_resource *resource, int view_id)
+static void touch_motion(struct wl_client *client, struct wl_resource *resource,
+    int id, int x, int y)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    wayfire_view view = view_from_id(view_id);
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
-    if (!view)
+    if (!wd->touch_points.count(id))
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
         return;
     }
 
-    view->tile_request(0);
-    for (auto r : wd->client_resources)
+    if (!wd->touch_motion_event(id, x, y))
     {
-        wf_ctrl_base_send_ack(r);
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
     }
+
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void minimize(struct wl_client *client, struct wl_resource *resource, int view_id)
+static void touch_up(struct wl_client *client, struct wl_resource *resource, int id)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    if (!wd->touch_points.erase(id))
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
 
-    wayfire_view view = view_from_id(view_id);
+    wd->touch_up_event(id);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
 
-    if (!view)
+static void mousemove_output(struct wl_client *client, struct wl_resource *resource,
+    const char *output_name, int x, int y)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    auto output = wf::get_core().output_layout->find_output(output_name);
+    if (!output)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
         return;
     }
 
-    view->minimize_request(true);
-    for (auto r : wd->client_resources)
+    auto geometry = output->get_layout_geometry();
+    if ((x < 0) || (y < 0) || (x >= geometry.width) || (y >= geometry.height))
     {
-        wf_ctrl_base_send_ack(r);
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
     }
+
+    wd->motion_absolute_event(geometry.x + x, geometry.y + y);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void unminimize(struct wl_client *client, struct wl_resource *resource, int view_id)
+static void type_text(struct wl_client *client, struct wl_resource *resource, const char *text, int interval)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
-    wayfire_view view = view_from_id(view_id);
+    wayfire_control::typing_t job;
+    if (!wd->translate_text(text, job.chars))
+    {
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
+    }
 
-    if (!view)
+    if (job.chars.empty())
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_OK);
         return;
     }
 
-    view->minimize_request(false);
-    for (auto r : wd->client_resources)
+    job.interval = interval;
+    job.reply    = cl->defer_reply();
+    wd->typing.push_back(std::move(job));
+    if (wd->typing.size() == 1)
     {
-        wf_ctrl_base_send_ack(r);
+        wd->run_typing();
     }
 }
 
-static void focus(struct wl_client *client, struct wl_resource *resource, int view_id)
+static uint32_t view_state(wayfire_view view)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    uint32_t state = 0;
+    auto output    = view->get_output();
 
-    wayfire_view view = view_from_id(view_id);
+    if (view->minimized)
+    {
+        state |= WF_CTRL_BASE_VIEW_STATE_MINIMIZED;
+    }
 
-    if (!view)
+    if (view->tiled_edges)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
-        return;
+        state |= WF_CTRL_BASE_VIEW_STATE_TILED;
     }
 
-    auto output = view->get_output();
+    if (view->fullscreen)
+    {
+        state |= WF_CTRL_BASE_VIEW_STATE_FULLSCREEN;
+    }
 
-    if (!output)
+    if (output && (output == wf::get_core().get_active_output()) &&
+        (output->get_active_view() == view))
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
-        return;
+        state |= WF_CTRL_BASE_VIEW_STATE_FOCUSED;
     }
 
-    wf::get_core().focus_output(output);
-    output->focus_view(view, true);
-    output->workspace->request_workspace(
-        output->workspace->get_view_main_workspace(view));
-    for (auto r : wd->client_resources)
+    return state;
+}
+
+static void send_view_info(wayfire_control_client *cl, wayfire_view view)
+{
+    auto geometry  = view->get_wm_geometry();
+    auto output    = view->get_output();
+    wf::point_t ws = {0, 0};
+    if (output)
     {
-        wf_ctrl_base_send_ack(r);
+        ws = output->workspace->get_view_main_workspace(view);
     }
+
+    wf_ctrl_base_send_view_info(cl->resource, cl->serial, view->get_id(),
+        view->get_app_id().c_str(), view->get_title().c_str(),
+        geometry.x, geometry.y, geometry.width, geometry.height,
+        output ? output->handle->name : "", ws.x, ws.y, view_state(view));
 }
 
-static void close(struct wl_client *client, struct wl_resource *resource, int view_id)
+/*
+ * Views ID -2 stands for from now on. The title regex is compiled once
+ * here, views are matched against the selector by each request.
+ */
+static void set_selector(struct wl_client *client, struct wl_resource *resource,
+    const char *app_id, const char *title, const char *output, int ws_x, int ws_y)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = request_begin(resource);
 
-    wayfire_view view = view_from_id(view_id);
+    wayfire_control_selector selector;
+    selector.app_id = app_id;
+    selector.output = output;
+    selector.any_workspace = (ws_x < 0) || (ws_y < 0);
+    selector.workspace     = {ws_x, ws_y};
 
-    if (!view)
+    if (*title)
     {
-        for (auto r : wd->client_resources)
+        try
+        {
+            selector.title = std::regex(title);
+        } catch (const std::regex_error&)
         {
-            wf_ctrl_base_send_ack(r);
+            send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+            return;
         }
-        return;
     }
 
-    view->close();
-    for (auto r : wd->client_resources)
-    {
-        wf_ctrl_base_send_ack(r);
-    }
+    cl->selector = std::move(selector);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void move(struct wl_client *client, struct wl_resource *resource, int view_id, int x, int y)
+static void wait_view_mapped(struct wl_client *client, struct wl_resource *resource,
+    const char *app_id, uint32_t timeout)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = request_begin(resource);
 
-    wayfire_view view = view_from_id(view_id);
+    auto wait = std::make_unique<wayfire_control_wait>();
+    wait->type   = wayfire_control_wait::VIEW_MAPPED;
+    wait->app_id = app_id;
+    wait->reply  = cl->defer_reply();
+    cl->ctrl->add_wait(std::move(wait), timeout);
+}
+
+static void wait_geometry(struct wl_client *client, struct wl_resource *resource,
+    int view_id, int x, int y, int w, int h, uint32_t timeout)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
+    wayfire_view view = wd->view_from_id(view_id);
     if (!view)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_VIEW);
         return;
     }
 
-    view->move(x, y);
-    for (auto r : wd->client_resources)
-    {
-        wf_ctrl_base_send_ack(r);
-    }
+    auto wait = std::make_unique<wayfire_control_wait>();
+    wait->type     = wayfire_control_wait::GEOMETRY;
+    wait->view_id  = view->get_id();
+    wait->geometry = {x, y, w, h};
+    wait->reply    = cl->defer_reply();
+    wd->add_wait(std::move(wait), timeout);
 }
 
-static void resize(struct wl_client *client, struct wl_resource *resource, int view_id, int w, int h)
+static void wait_animation(struct wl_client *client, struct wl_resource *resource,
+    int view_id, uint32_t timeout)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    wayfire_view view = view_from_id(view_id);
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
+    wayfire_view view = wd->view_from_id(view_id);
     if (!view)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_VIEW);
         return;
     }
 
-    view->resize(w, h);
-    for (auto r : wd->client_resources)
+    if (!view->get_output())
     {
-        wf_ctrl_base_send_ack(r);
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
+        return;
     }
+
+    /* Checked after each frame of the view's output */
+    auto wait = std::make_unique<wayfire_control_wait>();
+    wait->type    = wayfire_control_wait::ANIMATION;
+    wait->view_id = view->get_id();
+    wait->output  = view->get_output();
+    wait->reply   = cl->defer_reply();
+    wd->add_wait(std::move(wait), timeout);
 }
 
-static void ws_switch_view_append(struct wl_client *client, struct wl_resource *resource, int view_id)
+static void wait_frame(struct wl_client *client, struct wl_resource *resource,
+    const char *output_name, uint32_t timeout)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    wayfire_view view = view_from_id(view_id);
+    auto cl = request_begin(resource);
+    auto& core = wf::get_core();
 
-    if (!view)
+    auto output = *output_name ?
+        core.output_layout->find_output(output_name) : core.get_active_output();
+    if (!output)
     {
+        send_done(cl, WF_CTRL_BASE_STATUS_NO_OUTPUT);
         return;
     }
 
-    wd->fixed_views.push_back(view);
+    auto wait = std::make_unique<wayfire_control_wait>();
+    wait->type   = wayfire_control_wait::FRAME;
+    wait->output = output;
+    wait->reply  = cl->defer_reply();
+    cl->ctrl->add_wait(std::move(wait), timeout);
 }
 
-static void ws_switch(struct wl_client *client, struct wl_resource *resource, const char *direction)
+static void set_ack_mode(struct wl_client *client, struct wl_resource *resource,
+    uint32_t mode, uint32_t timeout)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    auto output = wf::get_core().get_active_output();
+    auto cl = request_begin(resource);
 
-    if (!output)
+    if (mode > WF_CTRL_BASE_ACK_MODE_COMMIT)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
         return;
     }
 
-    auto ws = output->workspace->get_current_workspace();
+    cl->ack_mode    = mode;
+    cl->ack_timeout = timeout;
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
 
-    wayfire_view view;
+static void subscribe(struct wl_client *client, struct wl_resource *resource, uint32_t mask)
+{
+    auto cl = request_begin(resource);
 
-    if (!strcmp(direction, "up"))
-    {
-        if (wd->fixed_views.empty())
-        {
-            output->workspace->request_workspace({ws.x, ws.y - 1});
-        }
-        else
-        {
-            output->workspace->request_workspace({ws.x, ws.y - 1}, wd->fixed_views);
-        }
-    }
-    else if (!strcmp(direction, "down"))
-    {
-        if (wd->fixed_views.empty())
-        {
-            output->workspace->request_workspace({ws.x, ws.y + 1});
-        }
-        else
-        {
-            output->workspace->request_workspace({ws.x, ws.y + 1}, wd->fixed_views);
-        }
-    }
-    else if (!strcmp(direction, "left"))
-    {
-        if (wd->fixed_views.empty())
-        {
-            output->workspace->request_workspace({ws.x - 1, ws.y});
-        }
-        else
-        {
-            output->workspace->request_workspace({ws.x - 1, ws.y}, wd->fixed_views);
-        }
-    }
-    else if (!strcmp(direction, "right"))
+    cl->event_mask = mask;
+    cl->ctrl->update_subscriptions();
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
+
+/*
+ * Every view goes out in one burst of events ahead of the done event, so
+ * the whole list arrives with a single flush.
+ */
+static void list_views(struct wl_client *client, struct wl_resource *resource)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
+
+    std::vector<uint32_t> ids;
+    ids.reserve(wd->views.size());
+    for (auto& [id, view] : wd->views)
     {
-        if (wd->fixed_views.empty())
-        {
-            output->workspace->request_workspace({ws.x + 1, ws.y});
-        }
-        else
-        {
-            output->workspace->request_workspace({ws.x + 1, ws.y}, wd->fixed_views);
-        }
+        ids.push_back(id);
     }
 
-    wd->fixed_views.clear();
-
-    for (auto r : wd->client_resources)
+    std::sort(ids.begin(), ids.end());
+    for (auto id : ids)
     {
-        wf_ctrl_base_send_ack(r);
+        send_view_info(cl, wd->views[id]);
     }
+
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void ws_switch_abs(struct wl_client *client, struct wl_resource *resource, int x, int y)
+static void mouse_path(struct wl_client *client, struct wl_resource *resource,
+    struct wl_array *points, uint32_t curve, uint32_t duration)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
-    wf::point_t ws{x, y};
-
-    auto output = wf::get_core().get_active_output();
-
-    if (!output)
+    size_t count = points->size / (2 * sizeof(int32_t));
+    if ((count == 0) || (points->size % (2 * sizeof(int32_t))) ||
+        (curve > WF_CTRL_BASE_PATH_CURVE_BEZIER))
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
         return;
     }
 
-    wayfire_view view;
-
-    if (wd->fixed_views.empty())
-    {
-        output->workspace->request_workspace(ws);
-    }
-    else
+    wayfire_control::pointer_path_t path;
+    auto coords = (int32_t*)points->data;
+    for (size_t i = 0; i < count; i++)
     {
-        output->workspace->request_workspace(ws, wd->fixed_views);
+        path.points.push_back({(double)coords[2 * i], (double)coords[2 * i + 1]});
     }
 
-    wd->fixed_views.clear();
-
-    for (auto r : wd->client_resources)
+    path.bezier   = curve == WF_CTRL_BASE_PATH_CURVE_BEZIER;
+    path.duration = duration;
+    path.reply    = cl->defer_reply();
+    wd->paths.push_back(std::move(path));
+    if (wd->paths.size() == 1)
     {
-        wf_ctrl_base_send_ack(r);
+        wd->run_paths();
     }
 }
 
-static void keystroke(struct wl_client *client, struct wl_resource *resource, const char *key, int delay)
+static void replay(struct wl_client *client, struct wl_resource *resource, int32_t script)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    int keycode = libevdev_event_code_from_name(EV_KEY, (std::string("KEY_") + key).c_str());
-    wlr_keyboard_key_event ev;
+    auto cl = request_begin(resource);
 
-    if (keycode == -1)
+    if (cl->replay && cl->replay->is_active())
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        ::close(script);
+        send_done(cl, WF_CTRL_BASE_STATUS_BUSY);
         return;
     }
 
-    ev.keycode = keycode;
-    ev.state   = WL_KEYBOARD_KEY_STATE_PRESSED;
-    ev.update_state = true;
-    ev.time_msec    = wf::get_current_time();
-
-    wlr_keyboard_notify_key(&wd->keyboard, &ev);
-
-    wd->keyboard_stroke_delay.set_timeout(delay, [=] ()
-    {
-        wlr_keyboard_key_event ev;
-        ev.keycode = keycode;
-        ev.state   = WL_KEYBOARD_KEY_STATE_RELEASED;
-        ev.update_state = true;
-        ev.time_msec    = wf::get_current_time();
-
-        wlr_keyboard_notify_key(&wd->keyboard, &ev);
-        return false;
-    });
-
-    for (auto r : wd->client_resources)
+    script = private_nonblocking_fd(script);
+    if (script < 0)
     {
-        wf_ctrl_base_send_ack(r);
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
     }
+
+    /* Answered once the script has been played to the end */
+    cl->replay = std::make_unique<wayfire_control_replay>(cl->ctrl, script,
+        cl->defer_reply());
 }
 
-static void keydown(struct wl_client *client, struct wl_resource *resource, const char *key)
+static void record(struct wl_client *client, struct wl_resource *resource, int32_t output)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    int keycode = libevdev_event_code_from_name(EV_KEY, (std::string("KEY_") + key).c_str());
-    wlr_keyboard_key_event ev;
+    auto cl = request_begin(resource);
 
-    if (keycode == -1)
+    if (cl->recorder)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        ::close(output);
+        send_done(cl, WF_CTRL_BASE_STATUS_BUSY);
         return;
     }
 
-    ev.keycode = keycode;
-    ev.state   = WL_KEYBOARD_KEY_STATE_PRESSED;
-    ev.update_state = true;
-    ev.time_msec    = wf::get_current_time();
-
-    wlr_keyboard_notify_key(&wd->keyboard, &ev);
-
-    for (auto r : wd->client_resources)
+    output = private_nonblocking_fd(output);
+    if (output < 0)
     {
-        wf_ctrl_base_send_ack(r);
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
+        return;
     }
+
+    cl->recorder = std::make_unique<wayfire_control_recorder>(cl->ctrl, output);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void keyup(struct wl_client *client, struct wl_resource *resource, const char *key)
+static void record_stop(struct wl_client *client, struct wl_resource *resource)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    int keycode = libevdev_event_code_from_name(EV_KEY, (std::string("KEY_") + key).c_str());
-    wlr_keyboard_key_event ev;
+    auto cl = request_begin(resource);
 
-    if (keycode == -1)
+    if (!cl->recorder)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        send_done(cl, WF_CTRL_BASE_STATUS_INVALID_ARGUMENT);
         return;
     }
 
-    ev.keycode = keycode;
-    ev.state   = WL_KEYBOARD_KEY_STATE_RELEASED;
-    ev.update_state = true;
-    ev.time_msec    = wf::get_current_time();
+    cl->recorder.reset();
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
 
-    wlr_keyboard_notify_key(&wd->keyboard, &ev);
+static void begin(struct wl_client *client, struct wl_resource *resource)
+{
+    auto cl = request_begin(resource);
 
-    for (auto r : wd->client_resources)
+    if (cl->in_transaction)
     {
-        wf_ctrl_base_send_ack(r);
+        wl_resource_post_error(resource, WF_CTRL_BASE_ERROR_BAD_TRANSACTION,
+            "transaction already in progress");
+        return;
     }
+
+    cl->in_transaction = true;
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
 }
 
-static void buttonstroke(struct wl_client *client, struct wl_resource *resource, const char *button, int delay)
+static void commit(struct wl_client *client, struct wl_resource *resource)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
-
-    int buttoncode = libevdev_event_code_from_name(EV_KEY, (std::string("BTN_") + button).c_str());
-    wlr_pointer_button_event ev;
+    auto cl = request_begin(resource);
 
-    if (buttoncode == -1)
+    if (!cl->in_transaction)
     {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
+        wl_resource_post_error(resource, WF_CTRL_BASE_ERROR_BAD_TRANSACTION,
+            "commit without begin");
         return;
     }
-    ev.pointer   = &wd->pointer;
-    ev.button    = buttoncode;
-    ev.state     = WLR_BUTTON_PRESSED;
-    ev.time_msec = wf::get_current_time();
-    wl_signal_emit(&wd->pointer.events.button, &ev);
-    wl_signal_emit(&wd->pointer.events.frame, NULL);
-
-    wd->button_stroke_delay.set_timeout(delay, [=] ()
-    {
-        wlr_pointer_button_event ev;
-        ev.pointer   = &wd->pointer;
-        ev.button    = buttoncode;
-        ev.state     = WLR_BUTTON_RELEASED;
-        ev.time_msec = wf::get_current_time();
-        wl_signal_emit(&wd->pointer.events.button, &ev);
-        wl_signal_emit(&wd->pointer.events.frame, NULL);
-        return false;
-    });
 
-    for (auto r : wd->client_resources)
-    {
-        wf_ctrl_base_send_ack(r);
-    }
+    /*
+     * Everything is applied within this one dispatch, so the resulting
+     * damage is picked up by the same repaint on each output.
+     */
+    auto ops = std::move(cl->transaction);
+    cl->transaction.clear();
+    cl->in_transaction = false;
+    apply_ops(cl, ops, cl->defer_reply(), std::exchange(cl->transaction_status,
+        WF_CTRL_BASE_STATUS_OK));
 }
 
-static void buttondown(struct wl_client *client, struct wl_resource *resource, const char *button)
+static void set_coalesce(struct wl_client *client, struct wl_resource *resource, uint32_t enable)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    /* Whatever was held back is applied before this */
+    auto cl = request_begin(resource);
 
-    int buttoncode = libevdev_event_code_from_name(EV_KEY, (std::string("BTN_") + button).c_str());
-    wlr_pointer_button_event ev;
+    cl->coalesce = enable;
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
 
-    if (buttoncode == -1)
-    {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
-        return;
-    }
+static void stats(struct wl_client *client, struct wl_resource *resource)
+{
+    auto cl = request_begin(resource);
+    wayfire_control *wd = cl->ctrl;
 
-    ev.pointer   = &wd->pointer;
-    ev.button    = buttoncode;
-    ev.state     = WLR_BUTTON_PRESSED;
-    ev.time_msec = wf::get_current_time();
-    wl_signal_emit(&wd->pointer.events.button, &ev);
-    wl_signal_emit(&wd->pointer.events.frame, NULL);
+    wd->send_queue_stats(cl);
+    wd->send_stats(cl);
+    send_done(cl, WF_CTRL_BASE_STATUS_OK);
+}
 
-    for (auto r : wd->client_resources)
-    {
-        wf_ctrl_base_send_ack(r);
-    }
+/* Every request of wf_ctrl_base, in protocol order */
+#define WAYFIRE_CONTROL_REQUESTS(REQUEST) \
+    REQUEST(maximize) \
+    REQUEST(unmaximize) \
+    REQUEST(minimize) \
+    REQUEST(unminimize) \
+    REQUEST(focus) \
+    REQUEST(close) \
+    REQUEST(move) \
+    REQUEST(resize) \
+    REQUEST(ws_switch_view_append) \
+    REQUEST(ws_switch) \
+    REQUEST(ws_switch_abs) \
+    REQUEST(keystroke) \
+    REQUEST(keydown) \
+    REQUEST(keyup) \
+    REQUEST(buttonstroke) \
+    REQUEST(buttondown) \
+    REQUEST(buttonup) \
+    REQUEST(mousemove) \
+    REQUEST(begin) \
+    REQUEST(commit) \
+    REQUEST(type_text) \
+    REQUEST(keystroke_code) \
+    REQUEST(keydown_code) \
+    REQUEST(keyup_code) \
+    REQUEST(buttonstroke_code) \
+    REQUEST(buttondown_code) \
+    REQUEST(buttonup_code) \
+    REQUEST(replay) \
+    REQUEST(record) \
+    REQUEST(record_stop) \
+    REQUEST(mouse_path) \
+    REQUEST(mousemove_output) \
+    REQUEST(axis) \
+    REQUEST(touch_down) \
+    REQUEST(touch_motion) \
+    REQUEST(touch_up) \
+    REQUEST(list_views) \
+    REQUEST(set_selector) \
+    REQUEST(subscribe) \
+    REQUEST(wait_view_mapped) \
+    REQUEST(wait_geometry) \
+    REQUEST(wait_animation) \
+    REQUEST(wait_frame) \
+    REQUEST(set_ack_mode) \
+    REQUEST(ws_switch_output) \
+    REQUEST(ws_switch_abs_output) \
+    REQUEST(stats) \
+    REQUEST(set_geometry) \
+    REQUEST(layout) \
+    REQUEST(save_layout) \
+    REQUEST(restore_layout) \
+    REQUEST(set_coalesce)
+
+#define REQUEST_HANDLER(name) .name = name,
+static const struct wf_ctrl_base_interface wayfire_control_impl =
+{
+    WAYFIRE_CONTROL_REQUESTS(REQUEST_HANDLER)
+};
+
+/* Unpack a wire argument into the type the handler takes */
+template<class T>
+static T request_argument(const wl_argument& arg);
+
+/* int, fixed and fd arguments are all int32_t */
+template<>
+int request_argument<int>(const wl_argument& arg)
+{
+    return arg.i;
 }
 
-static void buttonup(struct wl_client *client, struct wl_resource *resource, const char *button)
+template<>
+uint32_t request_argument<uint32_t>(const wl_argument& arg)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    return arg.u;
+}
 
-    int buttoncode = libevdev_event_code_from_name(EV_KEY, (std::string("BTN_") + button).c_str());
-    wlr_pointer_button_event ev;
+template<>
+const char *request_argument<const char*>(const wl_argument& arg)
+{
+    return arg.s;
+}
 
-    if (buttoncode == -1)
-    {
-        for (auto r : wd->client_resources)
-        {
-            wf_ctrl_base_send_ack(r);
-        }
-        return;
-    }
+template<>
+wl_array *request_argument<wl_array*>(const wl_argument& arg)
+{
+    return arg.a;
+}
 
-    ev.pointer   = &wd->pointer;
-    ev.button    = buttoncode;
-    ev.state     = WLR_BUTTON_RELEASED;
-    ev.time_msec = wf::get_current_time();
-    wl_signal_emit(&wd->pointer.events.button, &ev);
-    wl_signal_emit(&wd->pointer.events.frame, NULL);
+template<class... Args, size_t... I>
+static void invoke_handler(void (*handler)(wl_client*, wl_resource*, Args...),
+    wl_resource *resource, const wl_argument *args, std::index_sequence<I...>)
+{
+    handler(wl_resource_get_client(resource), resource,
+        request_argument<Args>(args[I])...);
+}
 
-    for (auto r : wd->client_resources)
-    {
-        wf_ctrl_base_send_ack(r);
-    }
+template<class... Args>
+static void invoke_handler(void (*handler)(wl_client*, wl_resource*, Args...),
+    wl_resource *resource, const wl_argument *args)
+{
+    invoke_handler(handler, resource, args, std::index_sequence_for<Args...>{});
 }
 
-static void mousemove(struct wl_client *client, struct wl_resource *resource, int x, int y)
+#define REQUEST_INVOKER(name) \
+    [] (wl_resource *resource, const wl_argument *args) \
+    { \
+        invoke_handler(wayfire_control_impl.name, resource, args); \
+    },
+static void (*const request_invokers[])(wl_resource*, const wl_argument*) =
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    WAYFIRE_CONTROL_REQUESTS(REQUEST_INVOKER)
+};
 
-    auto cursor = wf::get_core().get_cursor_position();
+void wayfire_control_invoke(wl_resource *resource, uint32_t opcode, const wl_argument *args)
+{
+    request_invokers[opcode](resource, args);
+}
 
-    wlr_pointer_motion_event ev;
-    ev.pointer   = &wd->pointer;
-    ev.time_msec = wf::get_current_time();
-    ev.delta_x   = ev.unaccel_dx = x - cursor.x;
-    ev.delta_y   = ev.unaccel_dy = y - cursor.y;
-    wl_signal_emit(&wd->pointer.events.motion, &ev);
-    wl_signal_emit(&wd->pointer.events.frame, NULL);
+/*
+ * Runs each request on a wf_ctrl_base in the dispatch it arrives in, or
+ * queues it behind the others of its client
+ */
+static int dispatch_request(const void *implementation, void *target,
+    uint32_t opcode, const wl_message *message, wl_argument *args)
+{
+    auto resource = (wl_resource*)target;
+    auto cl = (wayfire_control_client*)wl_resource_get_user_data(resource);
+    wayfire_control *wd = cl->ctrl;
 
-    for (auto r : wd->client_resources)
+    uint64_t sample = wd->begin_sample(message->name);
+    if (cl->queue.empty() && wd->budget_left())
+    {
+        wd->run_request(cl, opcode, sample, args);
+    }
+    else
     {
-        wf_ctrl_base_send_ack(r);
+        wd->queue_request(cl, wayfire_control_request(opcode, sample, message, args));
     }
+
+    return 0;
 }
 
-static const struct wf_ctrl_base_interface wayfire_control_impl =
+static int handle_queue_timer(void *data)
 {
-    .maximize                = maximize,
-    .unmaximize              = unmaximize,
-    .minimize                = minimize,
-    .unminimize              = unminimize,
-    .focus                   = focus,
-    .close                   = close,
-    .move                    = move,
-    .resize                  = resize,
-    .ws_switch_view_append   = ws_switch_view_append,
-    .ws_switch               = ws_switch,
-    .ws_switch_abs           = ws_switch_abs,
-    .keystroke               = keystroke,
-    .keydown                 = keydown,
-    .keyup                   = keyup,
-    .buttonstroke            = buttonstroke,
-    .buttondown              = buttondown,
-    .buttonup                = buttonup,
-    .mousemove               = mousemove
-};
+    ((wayfire_control*)data)->run_queues();
+    return 0;
+}
 
 static void destroy_client(wl_resource *resource)
 {
-    wayfire_control *wd = (wayfire_control*)wl_resource_get_user_data(resource);
+    auto cl = (wayfire_control_client*)wl_resource_get_user_data(resource);
+    auto ctrl = cl->ctrl;
+    auto& clients = ctrl->clients;
 
-    for (auto& r : wd->client_resources)
-    {
-        if (r == resource)
-        {
-            r = nullptr;
-        }
-    }
-    wd->client_resources.erase(std::remove(wd->client_resources.begin(),
-        wd->client_resources.end(), nullptr), wd->client_resources.end());
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+        [=] (auto& c) { return c.get() == cl; }), clients.end());
+    ctrl->update_subscriptions();
 }
 
 static void bind_manager(wl_client *client, void *data,
@@ -692,9 +2145,17 @@ static void bind_manager(wl_client *client, void *data,
     wayfire_control *wd = (wayfire_control*)data;
 
     auto resource =
-        wl_resource_create(client, &wf_ctrl_base_interface, 1, id);
-    wl_resource_set_implementation(resource,
-        &wayfire_control_impl, data, destroy_client);
-    wd->client_resources.push_back(resource);
-    
+        wl_resource_create(client, &wf_ctrl_base_interface, version, id);
+    if (!resource)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    auto cl = std::make_shared<wayfire_control_client>();
+    cl->ctrl     = wd;
+    cl->resource = resource;
+    wl_resource_set_dispatcher(resource, dispatch_request,
+        &wayfire_control_impl, cl.get(), destroy_client);
+    wd->clients.push_back(std::move(cl));
 }
@@ -25,19 +25,499 @@
 
 #pragma once
 
+#include <deque>
+#include <list>
+#include <memory>
+#include <map>
+#include <optional>
+#include <regex>
+#include <set>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <xkbcommon/xkbcommon.h>
+#include <wayfire/render-manager.hpp>
+#include <wayfire/option-wrapper.hpp>
+
+#include "event-names.hpp"
+
+class wayfire_control;
+class wayfire_control_replay;
+class wayfire_control_recorder;
+class wayfire_control_snapshot;
+struct wayfire_control_client;
+
+/*
+ * Microseconds of CLOCK_MONOTONIC, which timerfds also use. All times in
+ * the plugin come from it, in other units by division.
+ */
+int64_t monotonic_us();
+
+/*
+ * Get a nonblocking fd for client supplied @fd, without changing the flags
+ * of the file description it shares with the client, e.g. its tty. Pipes
+ * and devices are reopened and @fd is closed, -1 if that fails. Regular
+ * files never block and sockets are used with MSG_DONTWAIT, those are kept.
+ */
+int private_nonblocking_fd(int fd);
+
+/* read() from an fd given by private_nonblocking_fd */
+ssize_t read_nonblocking(int fd, void *data, size_t size);
+
+/*
+ * write() to an fd given by private_nonblocking_fd, failing with EPIPE
+ * instead of raising SIGPIPE in the compositor once its reader is gone
+ */
+ssize_t write_nosigpipe(int fd, const void *data, size_t size);
+
+/*
+ * When a request reached each stage, in microseconds of the monotonic
+ * clock, 0 for stages not reached
+ */
+struct wayfire_control_sample
+{
+    uint64_t id;
+    /* Request name, from the protocol's static tables */
+    const char *request;
+    int64_t receipt;
+    int64_t apply  = 0;
+    int64_t commit = 0;
+    int64_t frame  = 0;
+    /* IDs of the views yet to commit what the request did */
+    std::vector<uint32_t> views;
+    /* Output whose next frame shows the result, once known */
+    wf::output_t *output = nullptr;
+};
+
+/* A reply held back until a request has finished, e.g. after typing */
+struct wayfire_control_reply
+{
+    std::weak_ptr<wayfire_control_client> client;
+    uint32_t serial;
+    /* ID of the latency sample of the request */
+    uint64_t sample;
+
+    /* Does nothing if the client has gone away in the meantime */
+    void send(uint32_t status) const;
+};
+
+/* A view operation, applied right away or queued by a transaction */
+struct wayfire_control_op
+{
+    enum type_t
+    {
+        MAXIMIZE,
+        UNMAXIMIZE,
+        MINIMIZE,
+        UNMINIMIZE,
+        MOVE,
+        RESIZE,
+        SET_GEOMETRY,
+        TILE,
+    };
+
+    type_t type;
+    int32_t view_id;
+    int32_t x = 0, y = 0;
+    int32_t w = 0, h = 0;
+    /* Where SET_GEOMETRY puts the view, the one it is on if unset */
+    std::string output;
+    wf::point_t workspace = {-1, -1};
+    /* Edges TILE tiles the view to, 0 to untile it */
+    uint32_t edges = 0;
+};
+
+/* A wait_* request, answered once its condition holds or on timeout */
+struct wayfire_control_wait
+{
+    enum type_t
+    {
+        VIEW_MAPPED,
+        GEOMETRY,
+        ANIMATION,
+        FRAME,
+        COMMIT,
+    };
+
+    /*
+     * Milliseconds an ANIMATION wait given no timeout lasts at most, as its
+     * output is repainted every frame until it ends
+     */
+    static const uint32_t ANIMATION_TIMEOUT = 10000;
+
+    /* Milliseconds a COMMIT wait given no timeout lasts at most */
+    static const uint32_t COMMIT_TIMEOUT = 1000;
+
+    /* A view some geometry is expected from, for COMMIT */
+    struct target_t
+    {
+        enum mask_t
+        {
+            POSITION = 1 << 0,
+            SIZE     = 1 << 1,
+            /* Any geometry but the one it had */
+            CHANGE   = 1 << 2,
+        };
+
+        uint32_t view_id;
+        uint32_t mask;
+        wf::geometry_t geometry;
+        /* The geometry it had, for views that settle on a size of their own */
+        wf::geometry_t start;
+    };
+
+    type_t type;
+    wayfire_control *ctrl;
+    std::string app_id;
+    uint32_t view_id = 0;
+    wf::geometry_t geometry;
+    std::vector<target_t> targets;
+    /* Output whose frames are counted, if any */
+    wf::output_t *output = nullptr;
+    int frames = 0;
+    wl_event_source *timer = nullptr;
+    wayfire_control_reply reply;
+
+    ~wayfire_control_wait();
+};
+
+/* View ID standing for all views matched by the client's selector */
+static const int32_t SELECTED_VIEWS_ID = -2;
+
+/* Views matched by set_selector, empty strings match anything */
+struct wayfire_control_selector
+{
+    std::string app_id;
+    std::optional<std::regex> title;
+    std::string output;
+    bool any_workspace = true;
+    wf::point_t workspace;
+
+    bool matches(wayfire_view view) const;
+};
+
+std::vector<wf::geometry_t> wayfire_control_layout(uint32_t kind,
+    wf::geometry_t workarea, int count, int gap);
+
+/*
+ * A request waiting in its client's queue, with its strings and arrays
+ * copied out of the connection buffer. File descriptors it carries are
+ * closed if it never runs.
+ */
+struct wayfire_control_request
+{
+    uint32_t opcode;
+    /* Latency sample started on receipt */
+    uint64_t sample;
+    /* Argument types from the message signature, one char each */
+    std::string types;
+    std::vector<wl_argument> args;
+    std::vector<std::string> strings;
+    std::vector<std::vector<char>> arrays;
+    /* Set once the handler owns the file descriptors */
+    bool handed_over = false;
+
+    wayfire_control_request(uint32_t opcode, uint64_t sample,
+        const wl_message *message, const wl_argument *args);
+    wayfire_control_request(wayfire_control_request&& other) = default;
+    ~wayfire_control_request();
+
+    /* Arguments pointing into this request, backed by @storage for arrays */
+    std::vector<wl_argument> arguments(std::vector<wl_array>& storage);
+};
+
+/* Calls the handler of request @opcode on @resource */
+void wayfire_control_invoke(wl_resource *resource, uint32_t opcode, const wl_argument *args);
+
+/* Per-resource state of a bound wf_ctrl_base */
+struct wayfire_control_client :
+    public std::enable_shared_from_this<wayfire_control_client>
+{
+    wayfire_control *ctrl;
+    wl_resource *resource;
+    /* Serial of the request being handled, counted from 1 */
+    uint32_t serial = 0;
+    /* Latency sample of the request being handled, 0 if none */
+    uint64_t sample = 0;
+    /* Operations held back between begin and commit */
+    bool in_transaction = false;
+    std::vector<wayfire_control_op> transaction;
+    /* Status of the first queued request that failed before queuing */
+    uint32_t transaction_status = 0;
+
+    std::optional<wayfire_control_selector> selector;
+    /* Events asked for with subscribe */
+    uint32_t event_mask = 0;
+    /* When view operations are answered, see set_ack_mode */
+    uint32_t ack_mode    = 0;
+    uint32_t ack_timeout = 0;
+    std::vector<wayfire_view> select(int32_t view_id);
+    /* Views taken along by the next workspace switch */
+    std::vector<wayfire_view> fixed_views;
+
+    /* Input script being played back, and real input being recorded */
+    std::unique_ptr<wayfire_control_replay> replay;
+    std::unique_ptr<wayfire_control_recorder> recorder;
+    /* Layout snapshot being saved or restored */
+    std::unique_ptr<wayfire_control_snapshot> snapshot;
+
+    /*
+     * Geometry operations and pointer moves held back until the next
+     * frame in coalescing mode, in request order. Only the last one of
+     * each kind for a view, or for the pointer, is applied.
+     */
+    struct coalesced_t
+    {
+        wayfire_control_op op;
+        bool motion;
+        bool merged = false;
+        wayfire_control_reply reply;
+    };
+
+    bool coalesce = false;
+    std::vector<coalesced_t> coalesced;
+    void add_coalesced(coalesced_t entry);
+
+    /* Requests waiting for the scheduler, and counters to tune it with */
+    std::deque<wayfire_control_request> queue;
+    size_t max_queue_depth = 0;
+    /* Requests that had to wait, and requests run */
+    uint64_t throttled  = 0;
+    uint64_t dispatched = 0;
+
+    /* Reply to the request being handled later on */
+    wayfire_control_reply defer_reply();
+};
+
 class wayfire_control
 {
     wl_global *manager;
+    wf::signal_connection_t on_view_mapped;
+    wf::signal_connection_t on_view_unmapped;
 
   public:
-    std::vector<wl_resource*> client_resources;
-    std::vector<wayfire_view> fixed_views;
+    std::vector<std::shared_ptr<wayfire_control_client>> clients;
+    /* Mapped views by ID, kept current from the core map/unmap signals */
+    std::unordered_map<uint32_t, wayfire_view> views;
     wayfire_control();
     ~wayfire_control();
 
+    wayfire_view view_from_id(int32_t id);
+    /* Returns a wf_ctrl_base status */
+    uint32_t apply(const wayfire_control_op& op);
+    uint32_t target_geometry(const wayfire_control_op& op, wayfire_view view,
+        wf::output_t*& output, wf::geometry_t& geometry);
+
+    /* Layout snapshots, see snapshot.hpp */
+    std::string save_layout();
+    uint32_t restore_layout(const std::string& data, std::vector<wayfire_control_op>& ops);
+
     wlr_backend *backend;
     wlr_pointer pointer;
     wlr_keyboard keyboard;
-    wf::wl_timer keyboard_stroke_delay;
-    wf::wl_timer button_stroke_delay;
+    wlr_touch touch;
+
+    wayfire_control_event_names event_names;
+
+    void key_event(uint32_t keycode, wl_keyboard_key_state state);
+    void button_event(uint32_t button, wlr_button_state state);
+    void motion_event(double dx, double dy);
+    bool motion_absolute_event(double x, double y);
+    void axis_event(wlr_axis_orientation orientation, double delta, int32_t discrete);
+
+    /* IDs of the touch points currently down */
+    std::unordered_set<int32_t> touch_points;
+    bool touch_down_event(int32_t id, double x, double y);
+    bool touch_motion_event(int32_t id, double x, double y);
+    void touch_up_event(int32_t id);
+
+    /*
+     * Releases of stroked keys and buttons. They are kept in a min-heap
+     * on their due time and driven by a single timer, so overlapping
+     * strokes each get released on time.
+     */
+    struct release_t
+    {
+        int64_t time;
+        uint64_t seq;
+        bool button;
+        uint32_t code;
+    };
+
+    std::vector<release_t> releases;
+    /* The live heap entry of each key or button with a release pending */
+    std::unordered_map<uint32_t, uint64_t> pending_releases;
+    uint64_t release_seq = 0;
+    wl_event_source *release_timer;
+
+    void stroke_event(bool button, uint32_t code, bool pressed);
+    void stroke(bool button, uint32_t code, int delay);
+    bool cancel_release(bool button, uint32_t code);
+    void dispatch_releases();
+    void arm_release_timer();
+
+    /* A character of type_text, with the modifier keys it needs */
+    struct typed_char_t
+    {
+        std::vector<uint32_t> modifiers;
+        uint32_t keycode;
+    };
+
+    struct typing_t
+    {
+        std::vector<typed_char_t> chars;
+        size_t next = 0;
+        int interval;
+        wayfire_control_reply reply;
+    };
+
+    /* Text being typed, one request after the other */
+    std::deque<typing_t> typing;
+    wl_event_source *typing_timer;
+
+    /* How to produce each keysym of keysym_keymap */
+    struct keysym_key_t
+    {
+        uint32_t keycode;
+        xkb_mod_mask_t modifiers;
+    };
+
+    std::unordered_map<xkb_keysym_t, keysym_key_t> keysym_keys;
+    xkb_keymap *keysym_keymap = nullptr;
+
+    xkb_keymap *get_keymap();
+    void update_keysym_keys(xkb_keymap *keymap);
+    bool translate_text(const char *text, std::vector<typed_char_t>& chars);
+    void type_char(const typed_char_t& c);
+    void run_typing();
+
+    /* A mouse_path request, moved along once per output frame */
+    struct pointer_path_t
+    {
+        std::vector<wf::pointf_t> points;
+        bool bezier;
+        uint32_t duration;
+        /* When the path started, or -1 while queued */
+        int64_t start = -1;
+        wayfire_control_reply reply;
+    };
+
+    /* Paths being followed, one request after the other */
+    std::deque<pointer_path_t> paths;
+    wl_event_source *path_timer;
+
+    void run_paths();
+
+    /* Flushes the operations of coalescing clients once per frame */
+    wl_event_source *coalesce_timer;
+    bool coalesce_pending = false;
+
+    /*
+     * Microseconds between frames of the fastest output, pacing all that
+     * is done once per frame: coalescing, events, paths and budgets
+     */
+    static int64_t frame_interval_us();
+
+    /*
+     * Changes clients subscribed to, gathered until the next frame so a
+     * burst of changes to a view becomes a single event.
+     */
+    uint32_t subscribed_events = 0;
+    uint32_t pending_events    = 0;
+    std::map<uint32_t, uint32_t> pending_views;
+    uint32_t pending_focus = 0;
+    std::map<std::string, wf::point_t> pending_workspaces;
+    wl_event_source *events_timer;
+
+    wf::signal_connection_t on_view_geometry_changed;
+    wf::signal_connection_t on_focus_view;
+    wf::signal_connection_t on_workspace_changed;
+    wf::signal_connection_t on_output_added;
+
+    void init_events();
+    void fini_events();
+    void connect_output_events(wf::output_t *output);
+    void view_mapped(wayfire_view view);
+    void view_unmapped(wayfire_view view);
+    void queue_event(uint32_t event);
+    void queue_view_event(uint32_t id, uint32_t event);
+    void update_subscriptions();
+    void flush_events();
+
+    struct frame_hook_t
+    {
+        wf::effect_hook_t hook;
+        bool active = false;
+    };
+
+    std::list<std::unique_ptr<wayfire_control_wait>> waits;
+    std::map<wf::output_t*, frame_hook_t> frame_hooks;
+    wf::signal_connection_t on_output_removed;
+
+    bool wait_done(const wayfire_control_wait& wait, uint32_t& status);
+    void add_wait(std::unique_ptr<wayfire_control_wait> wait, uint32_t timeout);
+    void finish_wait(wayfire_control_wait *wait, uint32_t status);
+    void end_wait(const wayfire_control_wait& wait, uint32_t status);
+    void add_commit_target(wayfire_control_wait& wait, const wayfire_control_op& op);
+    void check_waits(wayfire_control_wait::type_t type);
+    void hook_frames(wf::output_t *output, bool redraw = true);
+    void handle_frame(wf::output_t *output);
+    void output_removed(wf::output_t *output);
+
+    /*
+     * Latency of requests. Samples are open from receipt until the frame
+     * showing their result, then kept in a ring of the last ones for the
+     * stats request. Everything runs on the event loop, so none of it
+     * needs any locking.
+     */
+    static const size_t SAMPLE_RING_SIZE = 1024;
+    std::unordered_map<uint64_t, wayfire_control_sample> open_samples;
+    /*
+     * Open samples to expire, oldest first: those not answered yet by ID,
+     * which is receipt order, and answered ones in the order answered.
+     * Samples leave the first once answered, so long requests like waits
+     * do not hold back the expiry of later ones.
+     */
+    std::set<uint64_t> unanswered_samples;
+    std::deque<uint64_t> answered_samples;
+    /* Open samples waiting for a view to commit, by view ID */
+    std::unordered_map<uint32_t, std::vector<uint64_t>> commit_samples;
+    /* Open samples waiting for the next frame of an output */
+    std::unordered_map<wf::output_t*, std::vector<uint64_t>> frame_samples;
+    std::vector<wayfire_control_sample> sample_ring;
+    size_t next_sample     = 0;
+    uint64_t last_sample_id = 0;
+
+    uint64_t begin_sample(const char *request);
+    void sample_views(uint64_t id, const std::vector<wayfire_view>& views);
+    void end_sample(uint64_t id);
+    void sample_commit(wayfire_view view);
+    void sample_frame(wf::output_t *output);
+    void wait_sample_frame(wayfire_control_sample& sample);
+    void expire_samples();
+    void close_sample(uint64_t id);
+    void record_sample(wayfire_control_sample& sample);
+    void send_stats(wayfire_control_client *cl);
+
+    /*
+     * Requests run in the dispatch they arrive in while their client has
+     * none queued and the frame budget lasts. The others wait in their
+     * client's queue, which the scheduler drains round-robin, one request
+     * per client in turn, within the budget of each following frame.
+     */
+    wf::option_wrapper_t<int> frame_budget{"wf-ctrl/frame_budget"};
+    wf::option_wrapper_t<int> queue_limit{"wf-ctrl/max_queue_depth"};
+    int64_t budget_window = 0;
+    int64_t budget_spent  = 0;
+    size_t next_queue = 0;
+    wl_event_source *queue_timer;
+    bool queue_timer_armed = false;
+
+    bool budget_left();
+    void run_request(wayfire_control_client *cl, uint32_t opcode, uint64_t sample,
+        const wl_argument *args);
+    void queue_request(wayfire_control_client *cl, wayfire_control_request request);
+    void run_queues();
+    void arm_queue_timer();
+    void send_queue_stats(wayfire_control_client *cl);
 };